@@ -0,0 +1,57 @@
+#include "accumulator.hpp"
+#include <algorithm>
+
+RenderResult Accumulator::resolve() const {
+    RenderResult render(width(), height());
+
+    for (std::size_t i = 0; i < radiance.pixels.size(); ++i) {
+        if (samples.pixels[i] == 0) {
+            continue;
+        }
+        const auto n = static_cast<float>(samples.pixels[i]);
+        render.color.pixels[i] = (radiance.pixels[i] + radianceError.pixels[i]) / n;
+        render.albedo.pixels[i] = albedo.pixels[i] / n;
+        // Averaging normals across an edge can yield a null vector
+        const Vector3& sumNormal = normal.pixels[i];
+        render.normal.pixels[i] =
+            sumNormal.lengthSquared() > 0.0f ? sumNormal.normalized() : sumNormal;
+        render.depth.pixels[i] = depth.pixels[i] / n;
+    }
+    render.cost.pixels.assign(cost.pixels.begin(), cost.pixels.end());
+    return render;
+}
+
+void Accumulator::clearRows(int firstRow, int lastRow) {
+    const std::size_t first = static_cast<std::size_t>(firstRow) * width();
+    const std::size_t last = static_cast<std::size_t>(lastRow) * width();
+    for (std::size_t i = first; i < last; ++i) {
+        radiance.pixels[i] = Color(0.0f);
+        radianceError.pixels[i] = Color(0.0f);
+        albedo.pixels[i] = Color(0.0f);
+        normal.pixels[i] = Vector3(0.0f, 0.0f, 0.0f);
+        depth.pixels[i] = 0.0f;
+        cost.pixels[i] = 0.0f;
+        samples.pixels[i] = 0;
+    }
+}
+
+void Accumulator::getPixelSums(std::size_t i, float* sums) const {
+    const Color& r = radiance.pixels[i];
+    const Color& e = radianceError.pixels[i];
+    const Color& a = albedo.pixels[i];
+    const Vector3& n = normal.pixels[i];
+    const float values[FLOATS_PER_PIXEL] = {r.r, r.g, r.b, e.r, e.g, e.b, a.r, a.g, a.b, n.x, n.y,
+                                            n.z, depth.pixels[i], cost.pixels[i]};
+    std::copy(values, values + FLOATS_PER_PIXEL, sums);
+}
+
+void Accumulator::addPixelSums(std::size_t i, const float* sums) {
+    const int x = static_cast<int>(i % static_cast<std::size_t>(width()));
+    const int y = static_cast<int>(i / static_cast<std::size_t>(width()));
+    addRadianceCompensated(x, y, Color(sums[0], sums[1], sums[2]));
+    radianceError.pixels[i] += Color(sums[3], sums[4], sums[5]);
+    albedo.pixels[i] += Color(sums[6], sums[7], sums[8]);
+    normal.pixels[i] += Vector3(sums[9], sums[10], sums[11]);
+    depth.pixels[i] += sums[12];
+    cost.pixels[i] += sums[13];
+}
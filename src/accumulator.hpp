@@ -0,0 +1,69 @@
+#ifndef ACCUMULATOR_HPP
+#define ACCUMULATOR_HPP
+
+#include "framebuffer.hpp"
+#include "trace.hpp"
+#include <cstddef>
+#include <cstdint>
+
+/* Running sums of the samples of each pixel, from which a render can be resolved at any time.
+   Along with the seed, the per-pixel sample counts fully determine the state of the sampler,
+   so that a render can be stopped and resumed without changing its result.
+   An accumulator can also cover only a region of the frame, whose top-left pixel is (x0, y0). */
+struct Accumulator {
+    template <typename T> using Buffer = Buffer2D<T, UninitializedAllocator<T>>;
+
+    Buffer<Color> radiance;
+    // What the additions to radiance lost to rounding : the exact sums are radiance +
+    // radianceError. Only kept up to date by addRadianceCompensated.
+    Buffer<Color> radianceError;
+    Buffer<Color> albedo;
+    Buffer<Vector3> normal;
+    Buffer<float> depth;
+    Buffer<float> cost;
+    Buffer<int> samples;
+    uint64_t seed;
+    int x0;
+    int y0;
+
+    Accumulator(int width, int height, uint64_t seed, int x0 = 0, int y0 = 0)
+        : radiance(width, height), radianceError(width, height), albedo(width, height),
+          normal(width, height, Vector3(0.0f, 0.0f, 0.0f)), depth(width, height),
+          cost(width, height), samples(width, height, 0), seed(seed), x0(x0), y0(y0) {}
+
+    /* Leaves the buffers uninitialized, so that each thread can first touch the rows it
+       renders with clearRows. Every row must be cleared before use. */
+    Accumulator(int width, int height, uint64_t seed, Uninitialized, int x0 = 0, int y0 = 0)
+        : radiance(width, height, Uninitialized()),
+          radianceError(width, height, Uninitialized()), albedo(width, height, Uninitialized()),
+          normal(width, height, Uninitialized()), depth(width, height, Uninitialized()),
+          cost(width, height, Uninitialized()), samples(width, height, Uninitialized()),
+          seed(seed), x0(x0), y0(y0) {}
+
+    /* Resets the rows in [firstRow, lastRow). */
+    void clearRows(int firstRow, int lastRow);
+
+    int width() const { return radiance.width; }
+    int height() const { return radiance.height; }
+
+    /* Adds value to the radiance of the pixel, accumulating the rounding error of the addition
+       (computed exactly by the TwoSum algorithm, without branches) in radianceError. The
+       compiler must not reassociate float operations, which rules out -ffast-math. */
+    void addRadianceCompensated(int x, int y, const Color& value) {
+        Color& sum = radiance(x, y);
+        const Color newSum = sum + value;
+        const Color addedPart = newSum - sum;
+        radianceError(x, y) += (sum - (newSum - addedPart)) + (value - addedPart);
+        sum = newSum;
+    }
+
+    RenderResult resolve() const;
+
+    /* The sums of the i-th pixel as a flat array, for serialization. Adding sums merges them
+       with compensated summation, which copies them exactly into an empty pixel. */
+    static constexpr int FLOATS_PER_PIXEL = 14;
+    void getPixelSums(std::size_t i, float* sums) const;
+    void addPixelSums(std::size_t i, const float* sums);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#include "animation.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+CameraSettings Animation::cameraAt(float time, const CameraSettings& base) const {
+    CameraSettings camera = base;
+    if (!cameraLocation.empty()) {
+        camera.location = cameraLocation.at(time);
+    }
+    if (!cameraTarget.empty()) {
+        camera.target = cameraTarget.at(time);
+    }
+    if (!cameraVfov.empty()) {
+        camera.vfov = cameraVfov.at(time);
+    }
+    return camera;
+}
+
+void renderSequence(const CameraSettings& camera, Scene& scene, const RenderParams& params,
+                    const Animation& animation, const SequenceParams& sequence,
+                    const ToneMapParams& toneMapping, const PNGEncodeSettings& pngSettings) {
+    // A checkpoint is only useful within a frame, and would be shared by all of them
+    RenderParams frameParams = params;
+    frameParams.checkpointFile.clear();
+    frameParams.resume = false;
+
+    // Objects are only updated when their translation changes
+    std::map<std::size_t, Vector3> translations;
+    for (int frame = sequence.firstFrame; frame < sequence.firstFrame + sequence.nFrames;
+         ++frame) {
+        std::ostringstream filename;
+        filename << sequence.outputPrefix << std::setw(4) << std::setfill('0') << frame;
+        if (sequence.skipExistingFrames && std::filesystem::exists(filename.str() + ".pfm")) {
+            continue;
+        }
+
+        const float time = static_cast<float>(frame) / sequence.framesPerSecond;
+        for (const auto& [object, track] : animation.objectTranslations) {
+            const Vector3 translation = track.at(time);
+            const auto previous = translations.find(object);
+            if (previous == translations.end() || !(previous->second == translation)) {
+                scene.setTranslation(object, translation);
+                translations.insert_or_assign(object, translation);
+            }
+        }
+
+        std::cout << "Frame " << frame << " (" << frame - sequence.firstFrame + 1 << '/'
+                  << sequence.nFrames << ")\n";
+        frameParams.seed = params.seed ^ Utils::hash(static_cast<uint64_t>(frame));
+        const RenderResult render =
+            rayTrace(animation.cameraAt(time, camera).makeCamera(), scene, frameParams);
+        saveRender(tonemap(render.color, toneMapping), filename.str() + ".png", pngSettings);
+        saveRenderToPFM(render.color, filename.str() + ".pfm");
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef ANIMATION_HPP
+#define ANIMATION_HPP
+
+#include "camera.hpp"
+#include "params.hpp"
+#include "save_render.hpp"
+#include "scene.hpp"
+#include "tonemap.hpp"
+#include "vector3.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* A value keyframed over time (in seconds), interpolated by a Catmull-Rom spline so that the
+   motion is smooth through the keyframes. It is constant before the first keyframe and after the
+   last one. T needs + and - between values, and * by a float. */
+template <typename T> class Track {
+    std::vector<float> times;
+    std::vector<T> values;
+
+  public:
+    /* Keyframes must be added in increasing time order. */
+    void addKeyframe(float time, const T& value) {
+        if (!times.empty() && time <= times.back()) {
+            throw std::runtime_error("Keyframes must be added in increasing time order");
+        }
+        times.push_back(time);
+        values.push_back(value);
+    }
+
+    bool empty() const { return times.empty(); }
+
+    /* Must not be empty. */
+    T at(float time) const {
+        if (time <= times.front()) {
+            return values.front();
+        }
+        if (time >= times.back()) {
+            return values.back();
+        }
+        const auto next = static_cast<std::size_t>(
+            std::upper_bound(times.begin(), times.end(), time) - times.begin());
+        const std::size_t i = next - 1;
+        const float t = (time - times[i]) / (times[next] - times[i]);
+        // The end keyframes are repeated to get the tangents at both ends of the track
+        const T& p0 = values[i > 0 ? i - 1 : i];
+        const T& p1 = values[i];
+        const T& p2 = values[next];
+        const T& p3 = values[next + 1 < values.size() ? next + 1 : next];
+        const float t2 = t * t;
+        const float t3 = t2 * t;
+        return p1 + ((p2 - p0) * t + (p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * t2 +
+                     ((p1 - p2) * 3.0f + p3 - p0) * t3) *
+                        0.5f;
+    }
+};
+
+/* Camera and object motion. Empty camera tracks keep the values of the base camera, and objects
+   (numbered as in Scene::objectCount) are translated from their original position. */
+struct Animation {
+    Track<Point3> cameraLocation;
+    Track<Point3> cameraTarget;
+    Track<float> cameraVfov;
+    std::map<std::size_t, Track<Vector3>> objectTranslations;
+
+    CameraSettings cameraAt(float time, const CameraSettings& base) const;
+};
+
+/* Frames firstFrame to firstFrame + nFrames - 1 of an animation starting at time 0, each saved
+   to <outputPrefix><frame number on 4 digits>.png and .pfm. */
+struct SequenceParams {
+    int nFrames = 1;
+    int firstFrame = 0;
+    float framesPerSecond = 24.0f;
+    std::string outputPrefix = "frame_";
+    // Skips the frames whose PFM file already exists, to continue an interrupted sequence
+    bool skipExistingFrames = false;
+};
+
+/* Renders the frames of the animation, reusing the scene from one frame to the next : it is left
+   untouched when only the camera moves, and only the moving objects are updated otherwise. Each
+   frame has its own seed (derived from params.seed), so that the noise doesn't stay still on the
+   screen. The scene is left as it is at the last frame. */
+void renderSequence(const CameraSettings& camera, Scene& scene, const RenderParams& params,
+                    const Animation& animation, const SequenceParams& sequence,
+                    const ToneMapParams& toneMapping,
+                    const PNGEncodeSettings& pngSettings = PNGEncodeSettings());
+
+#endif
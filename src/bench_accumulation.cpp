@@ -0,0 +1,146 @@
+/* Throughput and precision of the ways to add up the passes of the pixels : single precision
+   sums (the default), compensated sums (RenderParams::compensatedAccumulation) and double
+   precision sums, which the renderer doesn't use but are a common alternative. Errors are
+   measured against sums in long double.
+   Usage : ./bench_accumulation [passes] [width] [height]
+   Build it with optimizations (cmake -DCMAKE_BUILD_TYPE=Release ..) for meaningful timings. */
+
+#include "accumulator.hpp"
+#include "color.hpp"
+#include "framebuffer.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+struct DoubleColor {
+    double r = 0.0;
+    double g = 0.0;
+    double b = 0.0;
+};
+
+struct LongDoubleColor {
+    long double r = 0.0L;
+    long double g = 0.0L;
+    long double b = 0.0L;
+};
+
+/* Seconds taken by addPass, called once for each pass. */
+double timePasses(int nPasses, const std::function<void(int)>& addPass) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < nPasses; ++pass) {
+        addPass(pass);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Mean and max relative error of the sums, over all components. */
+template <typename Sums>
+void printResult(const std::string& name, double seconds, std::size_t nAdds,
+                 const std::vector<LongDoubleColor>& exact, Sums sumOf) {
+    double totalError = 0.0;
+    double maxError = 0.0;
+    for (std::size_t i = 0; i < exact.size(); ++i) {
+        const DoubleColor sum = sumOf(i);
+        const double errors[] = {
+            static_cast<double>(std::fabs((sum.r - exact[i].r) / exact[i].r)),
+            static_cast<double>(std::fabs((sum.g - exact[i].g) / exact[i].g)),
+            static_cast<double>(std::fabs((sum.b - exact[i].b) / exact[i].b))};
+        for (double error : errors) {
+            totalError += error;
+            maxError = std::max(maxError, error);
+        }
+    }
+    std::cout << std::left << std::setw(14) << name << std::right << std::setw(10)
+              << std::setprecision(3) << std::fixed << 1e9 * seconds / static_cast<double>(nAdds)
+              << " ns/add" << std::setw(14) << std::scientific
+              << totalError / static_cast<double>(3 * exact.size()) << " mean error"
+              << std::setw(14) << maxError << " max error\n"
+              << std::defaultfloat;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    const int nPasses = argc > 1 ? std::stoi(argv[1]) : 2048;
+    const int width = argc > 2 ? std::stoi(argv[2]) : 256;
+    const int height = argc > 3 ? std::stoi(argv[3]) : 256;
+    const std::size_t nPixels = static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+    const std::size_t nAdds = nPixels * static_cast<std::size_t>(nPasses);
+
+    // Sums of 8 samples, mostly dim with a few bright ones as in a path traced pass. Pixels
+    // read them at different offsets, which is enough to decorrelate their sums.
+    constexpr std::size_t N_VALUES = 1 << 16;
+    std::vector<Color> passValues(N_VALUES);
+    Utils::seedRandom(42);
+    for (Color& value : passValues) {
+        for (int sample = 0; sample < 8; ++sample) {
+            const float u = Utils::random();
+            const float scale = u < 0.01f ? 50.0f : 0.5f;
+            value += Color(scale * Utils::random(), scale * Utils::random(),
+                           scale * Utils::random());
+        }
+    }
+    auto valueAt = [&passValues](std::size_t pixel, int pass) -> const Color& {
+        return passValues[(pixel * 7919 + static_cast<std::size_t>(pass)) % N_VALUES];
+    };
+
+    std::cout << nPasses << " passes of " << width << "x" << height << " pixels\n";
+
+    std::vector<LongDoubleColor> exact(nPixels);
+    for (int pass = 0; pass < nPasses; ++pass) {
+        for (std::size_t i = 0; i < nPixels; ++i) {
+            const Color& value = valueAt(i, pass);
+            exact[i].r += value.r;
+            exact[i].g += value.g;
+            exact[i].b += value.b;
+        }
+    }
+
+    Accumulator single(width, height, 0);
+    const double singleTime = timePasses(nPasses, [&](int pass) {
+        for (std::size_t i = 0; i < nPixels; ++i) {
+            single.radiance.pixels[i] += valueAt(i, pass);
+        }
+    });
+    printResult("float", singleTime, nAdds, exact, [&](std::size_t i) {
+        const Color& sum = single.radiance.pixels[i];
+        return DoubleColor{sum.r, sum.g, sum.b};
+    });
+
+    Accumulator compensated(width, height, 0);
+    const double compensatedTime = timePasses(nPasses, [&](int pass) {
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const std::size_t i = static_cast<std::size_t>(y) * width + x;
+                compensated.addRadianceCompensated(x, y, valueAt(i, pass));
+            }
+        }
+    });
+    printResult("compensated", compensatedTime, nAdds, exact, [&](std::size_t i) {
+        const Color& sum = compensated.radiance.pixels[i];
+        const Color& error = compensated.radianceError.pixels[i];
+        return DoubleColor{static_cast<double>(sum.r) + error.r,
+                           static_cast<double>(sum.g) + error.g,
+                           static_cast<double>(sum.b) + error.b};
+    });
+
+    Buffer2D<DoubleColor> doubles(width, height);
+    const double doubleTime = timePasses(nPasses, [&](int pass) {
+        for (std::size_t i = 0; i < nPixels; ++i) {
+            const Color& value = valueAt(i, pass);
+            doubles.pixels[i].r += value.r;
+            doubles.pixels[i].g += value.g;
+            doubles.pixels[i].b += value.b;
+        }
+    });
+    printResult("double", doubleTime, nAdds, exact,
+                [&](std::size_t i) { return doubles.pixels[i]; });
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "camera.hpp"
+#include "ray.hpp"
+#include "sampling.hpp"
+#include "utils.hpp"
+#include "vector3.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+void CameraRayBatch::resize(std::size_t n) {
+    for (auto* array : {&originX, &originY, &originZ, &directionX, &directionY, &directionZ,
+                        &pixelX, &pixelY, &lensX, &lensY, &time}) {
+        array->resize(n);
+    }
+}
+
+Ray PerspectiveCamera::makeRay(float x, float y, int width, int height, float lensU,
+                               float lensV) const {
+    float u = 2.0f * (x - static_cast<float>(width) / 2.0f) / height;
+    float v = 2.0f * (static_cast<float>(height) / 2.0f - y) / height;
+    Vector3 direction{forward + u * maxV * right + v * up * maxV};
+    if (lensRadius == 0.0f) {
+        Ray ray(location, direction.normalized());
+        ray.time = shutterOpen;
+        return ray;
+    }
+
+    auto [lensX, lensY] = sampleDiskConcentric(lensU, lensV);
+    Vector3 lensOffset = lensRadius * (lensX * right + lensY * up);
+    // direction has a unit component along forward, so this is the point on the focus plane
+    Ray ray(location + lensOffset, (focusDistance * direction - lensOffset).normalized());
+    ray.time = shutterOpen;
+    return ray;
+}
+
+void PerspectiveCamera::generateRays(int x0, int y0, int x1, int y1, int firstSample,
+                                     int nSamples, uint64_t seed, int width, int height,
+                                     CameraRayBatch& batch) const {
+    const int nRays = (x1 - x0) * (y1 - y0) * nSamples;
+    batch.resize(nRays);
+
+    // Jitter, from a hash of the pixel and sample indices rather than from the generator of the
+    // thread, so that it doesn't depend on the order in which rays are traced.
+    const bool thinLens = lensRadius > 0.0f;
+    const float shutterDuration = shutterClose - shutterOpen;
+    const bool motionBlur = shutterDuration > 0.0f;
+    const uint64_t jitterSeed = Utils::hash(seed ^ 0x6a09e667f3bcc908ull);
+    int i = 0;
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            const auto pixelIndex = static_cast<uint64_t>(y) * width + x;
+            for (int s = firstSample; s < firstSample + nSamples; ++s, ++i) {
+                const uint64_t key = jitterSeed ^ (pixelIndex << 24 | static_cast<uint64_t>(s));
+                const uint64_t bits = Utils::hash(key);
+                batch.pixelX[i] = static_cast<float>(x) + Utils::unitFloat(bits) - 0.5f;
+                batch.pixelY[i] = static_cast<float>(y) + Utils::unitFloat(bits << 24) - 0.5f;
+                if (thinLens) {
+                    const uint64_t lensBits = Utils::hash(key ^ (1ull << 63));
+                    auto [lensX, lensY] = sampleDiskConcentric(Utils::unitFloat(lensBits),
+                                                               Utils::unitFloat(lensBits << 24));
+                    batch.lensX[i] = lensRadius * lensX;
+                    batch.lensY[i] = lensRadius * lensY;
+                }
+                batch.time[i] = shutterOpen;
+                if (motionBlur) {
+                    const uint64_t timeBits = Utils::hash(key ^ (1ull << 62));
+                    batch.time[i] += shutterDuration * Utils::unitFloat(timeBits);
+                }
+            }
+        }
+    }
+
+    // The direction through the image point (x, y) is base + x * perColumn + y * perRow, with
+    // a unit component along forward (see makeRay).
+    const float pixelSize = 2.0f * maxV / static_cast<float>(height);
+    const Vector3 perColumn = pixelSize * right;
+    const Vector3 perRow = -pixelSize * up;
+    const Vector3 base =
+        forward - (static_cast<float>(width) / static_cast<float>(height)) * maxV * right +
+        maxV * up;
+    const float focus = thinLens ? focusDistance : 1.0f;
+
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+    for (int j = 0; j < nRays; ++j) {
+        const float px = batch.pixelX[j];
+        const float py = batch.pixelY[j];
+        const float lx = thinLens ? batch.lensX[j] : 0.0f;
+        const float ly = thinLens ? batch.lensY[j] : 0.0f;
+        const float offsetX = lx * right.x + ly * up.x;
+        const float offsetY = lx * right.y + ly * up.y;
+        const float offsetZ = lx * right.z + ly * up.z;
+        const float dx = focus * (base.x + px * perColumn.x + py * perRow.x) - offsetX;
+        const float dy = focus * (base.y + px * perColumn.y + py * perRow.y) - offsetY;
+        const float dz = focus * (base.z + px * perColumn.z + py * perRow.z) - offsetZ;
+        const float invLength = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz);
+        batch.originX[j] = location.x + offsetX;
+        batch.originY[j] = location.y + offsetY;
+        batch.originZ[j] = location.z + offsetZ;
+        batch.directionX[j] = dx * invLength;
+        batch.directionY[j] = dy * invLength;
+        batch.directionZ[j] = dz * invLength;
+    }
+}
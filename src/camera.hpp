@@ -3,8 +3,42 @@
 
 #include "ray.hpp"
 #include "vector3.hpp"
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 
+/* Camera rays in structure of arrays, so that they are generated (and can be traced) by loops
+   the compiler can vectorize. */
+struct CameraRayBatch {
+    std::vector<float> originX;
+    std::vector<float> originY;
+    std::vector<float> originZ;
+    std::vector<float> directionX;
+    std::vector<float> directionY;
+    std::vector<float> directionZ;
+    // Jittered positions of the samples, on the image (in pixels) and on the lens
+    std::vector<float> pixelX;
+    std::vector<float> pixelY;
+    std::vector<float> lensX;
+    std::vector<float> lensY;
+    std::vector<float> time;
+
+    void resize(std::size_t n);
+    std::size_t size() const { return directionX.size(); }
+    Ray ray(std::size_t i) const {
+        Ray ray(Point3(originX[i], originY[i], originZ[i]),
+                Vector3(directionX[i], directionY[i], directionZ[i]));
+        ray.time = time[i];
+        return ray;
+    }
+};
+
+/* Thin lens camera : points at focusDistance are sharp, and the others are blurred the more the
+   larger the aperture (diameter of the lens). With an aperture of 0, it is a pinhole camera.
+   The shutter is open between times shutterOpen and shutterClose (see Ray::time) : moving
+   objects are blurred along their motion during that interval. */
 class PerspectiveCamera {
   private:
     Point3 location;
@@ -12,19 +46,49 @@ class PerspectiveCamera {
     Vector3 right;
     Vector3 up;
     float maxV;
+    float lensRadius;
+    float focusDistance;
+    float shutterOpen;
+    float shutterClose;
 
   public:
-    PerspectiveCamera(const Point3& location, const Point3& target, float vfov)
+    /* A focusDistance of 0 focuses on the target. */
+    PerspectiveCamera(const Point3& location, const Point3& target, float vfov,
+                      float aperture = 0.0f, float focusDistance = 0.0f, float shutterOpen = 0.0f,
+                      float shutterClose = 0.0f)
         : location(location), forward((target - location).normalized()),
           right(forward.cross(Vector3(0.0f, 1.0f, 0.0f)).normalized()), up(right.cross(forward)),
-          maxV(std::tan(vfov / 2)) {}
+          maxV(std::tan(vfov / 2)), lensRadius(aperture / 2.0f),
+          focusDistance(focusDistance > 0.0f ? focusDistance : (target - location).length()),
+          shutterOpen(shutterOpen), shutterClose(std::max(shutterClose, shutterOpen)) {}
+
+    /* (lensU, lensV) is a point of the unit square mapped onto the lens, its center by default.
+       The ray is traced when the shutter opens. */
+    Ray makeRay(float x, float y, int width, int height, float lensU = 0.5f,
+                float lensV = 0.5f) const;
+
+    /* Fills batch with nSamples jittered rays for each pixel of [x0, x1) x [y0, y1), starting
+       at sample index firstSample. Ray i is sample firstSample + i % nSamples of the
+       (i / nSamples)-th pixel, in row-major order. The jitter (in the pixel, on the lens and in
+       the shutter interval) only depends on seed and on the pixel and sample indices. */
+    void generateRays(int x0, int y0, int x1, int y1, int firstSample, int nSamples,
+                      uint64_t seed, int width, int height, CameraRayBatch& batch) const;
+};
+
+/* The parameters a PerspectiveCamera is built from, which it doesn't keep. */
+struct CameraSettings {
+    Point3 location;
+    Point3 target;
+    float vfov;
+    float aperture = 0.0f;
+    float focusDistance = 0.0f;
+    float shutterOpen = 0.0f;
+    float shutterClose = 0.0f;
 
-    Ray makeRay(float x, float y, int width, int height) const {
-        float u = 2.0f * (x - static_cast<float>(width) / 2.0f) / height;
-        float v = 2.0f * (static_cast<float>(height) / 2.0f - y) / height;
-        Vector3 direction{forward + u * maxV * right + v * up * maxV};
-        return Ray(location, direction.normalized());
+    PerspectiveCamera makeCamera() const {
+        return PerspectiveCamera(location, target, vfov, aperture, focusDistance, shutterOpen,
+                                 shutterClose);
     }
 };
 
-#endif
\ No newline at end of file
+#endif
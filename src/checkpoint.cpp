@@ -0,0 +1,108 @@
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+constexpr char MAGIC[4] = {'R', 'T', 'C', 'K'};
+constexpr uint32_t VERSION = 4;
+
+template <typename T> void write(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T> T read(std::ifstream& file) {
+    T value{};
+    file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+}
+} // namespace
+
+void saveCheckpoint(const Accumulator& accumulator, const std::string& filename) {
+    const std::string tmpFilename = filename + ".tmp";
+    {
+        std::ofstream file(tmpFilename, std::ios::binary);
+        file.write(MAGIC, sizeof(MAGIC));
+        write(file, VERSION);
+        write(file, static_cast<int32_t>(accumulator.width()));
+        write(file, static_cast<int32_t>(accumulator.height()));
+        write(file, accumulator.seed);
+        write(file, static_cast<int32_t>(accumulator.x0));
+        write(file, static_cast<int32_t>(accumulator.y0));
+
+        float sums[Accumulator::FLOATS_PER_PIXEL];
+        for (std::size_t i = 0; i < accumulator.samples.pixels.size(); ++i) {
+            write(file, static_cast<int32_t>(accumulator.samples.pixels[i]));
+            accumulator.getPixelSums(i, sums);
+            file.write(reinterpret_cast<const char*>(sums), sizeof(sums));
+        }
+
+        if (!file) {
+            throw std::runtime_error("Could not write checkpoint " + tmpFilename);
+        }
+    }
+    if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        throw std::runtime_error("Could not move checkpoint to " + filename);
+    }
+}
+
+Accumulator loadCheckpoint(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    char magic[sizeof(MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    if (!file || !std::equal(magic, magic + sizeof(magic), MAGIC) ||
+        read<uint32_t>(file) != VERSION) {
+        throw std::runtime_error("Not a valid checkpoint: " + filename);
+    }
+
+    const auto width = read<int32_t>(file);
+    const auto height = read<int32_t>(file);
+    const auto seed = read<uint64_t>(file);
+    const auto x0 = read<int32_t>(file);
+    const auto y0 = read<int32_t>(file);
+    if (!file || width <= 0 || height <= 0 || x0 < 0 || y0 < 0) {
+        throw std::runtime_error("Corrupted checkpoint header: " + filename);
+    }
+
+    Accumulator accumulator(width, height, seed, x0, y0);
+    float sums[Accumulator::FLOATS_PER_PIXEL];
+    for (std::size_t i = 0; i < accumulator.samples.pixels.size(); ++i) {
+        accumulator.samples.pixels[i] = read<int32_t>(file);
+        file.read(reinterpret_cast<char*>(sums), sizeof(sums));
+        accumulator.addPixelSums(i, sums);
+    }
+
+    if (!file) {
+        throw std::runtime_error("Truncated checkpoint: " + filename);
+    }
+    return accumulator;
+}
+
+std::optional<Accumulator> resumeFromCheckpoint(const RenderParams& params) {
+    if (!params.resume || params.checkpointFile.empty() ||
+        !std::ifstream(params.checkpointFile).good()) {
+        return {};
+    }
+
+    Accumulator accumulator = loadCheckpoint(params.checkpointFile);
+    const PixelRect region = params.region();
+    if (accumulator.width() != region.width() || accumulator.height() != region.height() ||
+        accumulator.x0 != region.x0 || accumulator.y0 != region.y0) {
+        throw std::runtime_error("Checkpoint " + params.checkpointFile +
+                                 " does not match the resolution or crop window of the render");
+    }
+    std::cout << "Resuming render from " << params.checkpointFile << std::endl;
+    return accumulator;
+}
+
+Accumulator loadOrCreateAccumulator(const RenderParams& params) {
+    std::optional<Accumulator> accumulator = resumeFromCheckpoint(params);
+    const PixelRect region = params.region();
+    return accumulator ? std::move(*accumulator)
+                       : Accumulator(region.width(), region.height(), params.seed, region.x0,
+                                     region.y0);
+}
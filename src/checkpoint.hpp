@@ -0,0 +1,22 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include "accumulator.hpp"
+#include "params.hpp"
+#include <optional>
+#include <string>
+
+/* Writes the accumulation buffers to a binary file. The file is written next to its
+   destination first and then renamed, so that a crash never leaves a corrupted checkpoint. */
+void saveCheckpoint(const Accumulator& accumulator, const std::string& filename);
+
+/* Throws std::runtime_error if the file is not a valid checkpoint. */
+Accumulator loadCheckpoint(const std::string& filename);
+
+/* Loads params.checkpointFile if params.resume is set and the file exists. */
+std::optional<Accumulator> resumeFromCheckpoint(const RenderParams& params);
+
+/* Same as resumeFromCheckpoint, returning an empty accumulator if there is nothing to resume. */
+Accumulator loadOrCreateAccumulator(const RenderParams& params);
+
+#endif
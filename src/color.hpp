@@ -3,30 +3,77 @@
 
 #include "utils.hpp"
 
-struct Color {
+/* Linear RGB, padded to 4 lanes and aligned on 16 bytes : the operators below are written lane by
+   lane over the 4 floats, so that the compiler turns each of them into a single SSE instruction on
+   aligned loads. The padding lane stays at 0 through every operation except division by 0. */
+struct alignas(16) Color {
     float r;
     float g;
     float b;
+    float padding;
 
-    static Color WHITE;
-    static Color BLACK;
+    // constexpr, but defined after the class : Color is still incomplete in its own body
+    static const Color WHITE;
+    static const Color BLACK;
 
-    Color() : r(0.0f), g(0.0f), b(0.0f) {}
-    Color(float f) : r(f), g(f), b(f) {}
-    Color(float red, float green, float blue) : r(red), g(green), b(blue) {}
+    constexpr Color() : r(0.0f), g(0.0f), b(0.0f), padding(0.0f) {}
+    constexpr Color(float f) : r(f), g(f), b(f), padding(0.0f) {}
+    constexpr Color(float red, float green, float blue)
+        : r(red), g(green), b(blue), padding(0.0f) {}
 
-    Color clamped(float max = 1.0f) const;
+    Color clamped(float max = 1.0f) const {
+        return Color(Utils::clamp(r, max), Utils::clamp(g, max), Utils::clamp(b, max));
+    }
+    /* Perceived brightness of the linear color (Rec. 709 weights). */
+    constexpr float luminance() const { return 0.2126f * r + 0.7152f * g + 0.0722f * b; }
 
-    Color& operator+=(const Color& other);
-    Color& operator/=(float f);
+    constexpr Color& operator+=(const Color& other) {
+        r += other.r;
+        g += other.g;
+        b += other.b;
+        padding += other.padding;
+        return *this;
+    }
+    constexpr Color& operator/=(float f) {
+        r /= f;
+        g /= f;
+        b /= f;
+        padding /= f;
+        return *this;
+    }
+    /* Ignores the padding lane. */
     bool operator==(const Color& other) const;
     bool operator!=(const Color& other) const;
+
+  private:
+    constexpr Color(float red, float green, float blue, float pad)
+        : r(red), g(green), b(blue), padding(pad) {}
+
+    friend constexpr Color operator*(const Color& c1, const Color& c2);
+    friend constexpr Color operator*(const Color& c, float f);
+    friend constexpr Color operator+(const Color& c1, const Color& c2);
+    friend constexpr Color operator-(const Color& c1, const Color& c2);
+    friend constexpr Color operator/(const Color& c, float f);
 };
 
-Color operator*(const Color& c1, const Color& c2);
-Color operator*(float f, const Color& c);
-Color operator*(const Color& c, float f);
-Color operator+(const Color& c1, const Color& c2);
-Color operator/(const Color& c, float f);
+inline constexpr Color Color::WHITE{1.0f};
+inline constexpr Color Color::BLACK{0.0f};
+
+inline constexpr Color operator*(const Color& c1, const Color& c2) {
+    return Color(c1.r * c2.r, c1.g * c2.g, c1.b * c2.b, c1.padding * c2.padding);
+}
+inline constexpr Color operator*(const Color& c, float f) {
+    return Color(c.r * f, c.g * f, c.b * f, c.padding * f);
+}
+inline constexpr Color operator*(float f, const Color& c) { return c * f; }
+inline constexpr Color operator+(const Color& c1, const Color& c2) {
+    return Color(c1.r + c2.r, c1.g + c2.g, c1.b + c2.b, c1.padding + c2.padding);
+}
+inline constexpr Color operator-(const Color& c1, const Color& c2) {
+    return Color(c1.r - c2.r, c1.g - c2.g, c1.b - c2.b, c1.padding - c2.padding);
+}
+inline constexpr Color operator/(const Color& c, float f) {
+    return Color(c.r / f, c.g / f, c.b / f, c.padding / f);
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,98 @@
+#include "denoise.hpp"
+#include "color.hpp"
+#include "fastmath.hpp"
+#include "profiler.hpp"
+#include "utils.hpp"
+#include "vector3.hpp"
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace {
+float squaredDistance(const Color& c1, const Color& c2) {
+    return Utils::sqr(c1.r - c2.r) + Utils::sqr(c1.g - c2.g) + Utils::sqr(c1.b - c2.b);
+}
+
+float inverseTwoSigmaSquared(float sigma) { return 1.0f / (2.0f * Utils::sqr(sigma)); }
+
+/* Maps linear radiance to [0, 1) so that the color weights behave the same on bright lights
+   and on dark areas. */
+Framebuffer compressRange(const Framebuffer& linear) {
+    Framebuffer compressed(linear.width, linear.height);
+    for (std::size_t i = 0; i < linear.pixels.size(); ++i) {
+        const Color& c = linear.pixels[i];
+        compressed.pixels[i] = Color(c.r / (1.0f + c.r), c.g / (1.0f + c.g), c.b / (1.0f + c.b));
+    }
+    return compressed;
+}
+} // namespace
+
+Framebuffer denoise(const RenderResult& render, const DenoiseParams& params) {
+    PROFILE_SCOPE("denoise");
+    const int width = render.color.width;
+    const int height = render.color.height;
+    Framebuffer denoised(width, height);
+    const Framebuffer compressed = compressRange(render.color);
+
+    // The spatial weights only depend on the offset, so they are shared by all pixels
+    const int kernelWidth = 2 * params.radius + 1;
+    std::vector<float> spatialWeights(kernelWidth * kernelWidth);
+    const float spatialFactor = inverseTwoSigmaSquared(params.sigmaSpatial);
+    for (int dy = -params.radius; dy <= params.radius; ++dy) {
+        for (int dx = -params.radius; dx <= params.radius; ++dx) {
+            spatialWeights[(dy + params.radius) * kernelWidth + dx + params.radius] =
+                FastMath::exp(-static_cast<float>(dx * dx + dy * dy) * spatialFactor);
+        }
+    }
+
+    const float colorFactor = inverseTwoSigmaSquared(params.sigmaColor);
+    const float albedoFactor = inverseTwoSigmaSquared(params.sigmaAlbedo);
+    const float normalFactor = inverseTwoSigmaSquared(params.sigmaNormal);
+    const float depthFactor = inverseTwoSigmaSquared(params.sigmaDepth);
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(guided)
+#endif
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const Color& centerColor = compressed(x, y);
+            const Color& centerAlbedo = render.albedo(x, y);
+            const Vector3& centerNormal = render.normal(x, y);
+            const float centerDepth = render.depth(x, y);
+            const float depthScale = centerDepth > 0.0f ? 1.0f / centerDepth : 1.0f;
+
+            Color sum{0.0f};
+            float weightSum = 0.0f;
+            for (int dy = -params.radius; dy <= params.radius; ++dy) {
+                const int ny = y + dy;
+                if (ny < 0 || ny >= height) {
+                    continue;
+                }
+                for (int dx = -params.radius; dx <= params.radius; ++dx) {
+                    const int nx = x + dx;
+                    if (nx < 0 || nx >= width) {
+                        continue;
+                    }
+                    float normalDistance = 1.0f - centerNormal.dot(render.normal(nx, ny));
+                    float depthDistance = (render.depth(nx, ny) - centerDepth) * depthScale;
+
+                    float exponent =
+                        squaredDistance(centerColor, compressed(nx, ny)) * colorFactor +
+                        squaredDistance(centerAlbedo, render.albedo(nx, ny)) * albedoFactor +
+                        Utils::sqr(normalDistance) * normalFactor +
+                        Utils::sqr(depthDistance) * depthFactor;
+                    float weight =
+                        spatialWeights[(dy + params.radius) * kernelWidth + dx + params.radius] *
+                        FastMath::exp(-exponent);
+
+                    sum += weight * render.color(nx, ny);
+                    weightSum += weight;
+                }
+            }
+            // The center pixel always has a weight of 1, so weightSum can't be null
+            denoised(x, y) = sum / weightSum;
+        }
+    }
+
+    return denoised;
+}
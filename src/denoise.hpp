@@ -0,0 +1,24 @@
+#ifndef DENOISE_HPP
+#define DENOISE_HPP
+
+#include "framebuffer.hpp"
+#include "trace.hpp"
+
+/* Standard deviations of the Gaussian weights of the joint bilateral filter. A sample is only
+   blended with its neighbours if they are close in screen space and lie on a surface with
+   a similar albedo, normal and depth, so that edges and texture are preserved. */
+struct DenoiseParams {
+    int radius = 4;
+    float sigmaSpatial = 2.5f;
+    // Applies to colors mapped to [0, 1) with x / (1 + x)
+    float sigmaColor = 0.2f;
+    float sigmaAlbedo = 0.05f;
+    float sigmaNormal = 0.15f;
+    // Relative to the depth of the center pixel
+    float sigmaDepth = 0.05f;
+};
+
+/* Denoises the color buffer of the render, guided by its feature buffers. */
+Framebuffer denoise(const RenderResult& render, const DenoiseParams& params = DenoiseParams());
+
+#endif
@@ -0,0 +1,514 @@
+#include "distributed.hpp"
+#include "accumulator.hpp"
+#include "checkpoint.hpp"
+#include "profiler.hpp"
+#include "threads.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <netdb.h>
+#include <omp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+constexpr int32_t HELLO_MAGIC = 0x4b575452; // "RTWK"
+constexpr int32_t NO_MORE_TILES = -1;
+constexpr int POLL_TIMEOUT_MS = 1000;
+constexpr std::size_t PIXEL_SIZE =
+    sizeof(int32_t) + Accumulator::FLOATS_PER_PIXEL * sizeof(float);
+
+/* What a worker sends when connecting, so that the coordinator can check it renders the same
+   frame. */
+struct Hello {
+    int32_t magic;
+    int32_t width;
+    int32_t height;
+    int32_t nSamples;
+    int32_t samplesPerPass;
+    int32_t tileSize;
+    PixelRect region;
+    uint64_t seed;
+};
+
+Hello makeHello(const RenderParams& params) {
+    return Hello{HELLO_MAGIC,           params.width,    params.height,   params.nSamples,
+                 params.samplesPerPass, params.tileSize, params.region(), params.seed};
+}
+
+bool operator==(const Hello& h1, const Hello& h2) {
+    return h1.magic == h2.magic && h1.width == h2.width && h1.height == h2.height &&
+           h1.nSamples == h2.nSamples && h1.samplesPerPass == h2.samplesPerPass &&
+           h1.tileSize == h2.tileSize && h1.region.x0 == h2.region.x0 &&
+           h1.region.y0 == h2.region.y0 && h1.region.x1 == h2.region.x1 &&
+           h1.region.y1 == h2.region.y1 && h1.seed == h2.seed;
+}
+
+/* A tile to render, starting from a given number of samples per pixel. */
+struct Task {
+    int32_t tileIndex;
+    int32_t startSamples;
+};
+
+bool sendAll(int fd, const void* data, std::size_t size) {
+    const auto* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        size -= static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+bool receiveAll(int fd, void* data, std::size_t size) {
+    auto* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        bytes += received;
+        size -= static_cast<std::size_t>(received);
+    }
+    return true;
+}
+
+bool isUnixSocketPath(const std::string& address) {
+    return address.find('/') != std::string::npos;
+}
+
+sockaddr_un unixSocketAddress(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Unix socket path too long: " + path);
+    }
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+/* Resolves host:port for TCP. The caller must call freeaddrinfo on the result. */
+addrinfo* resolve(const std::string& address, bool passive) {
+    const std::size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        throw std::runtime_error("Expected a Unix socket path or host:port, got " + address);
+    }
+    const std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo* result = nullptr;
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (error != 0) {
+        throw std::runtime_error("Could not resolve " + address + ": " + gai_strerror(error));
+    }
+    return result;
+}
+
+int listenOn(const std::string& address) {
+    int fd = -1;
+    if (isUnixSocketPath(address)) {
+        sockaddr_un addr = unixSocketAddress(address);
+        unlink(address.c_str()); // Left over by a previous coordinator
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            throw std::runtime_error("Could not bind to " + address + ": " + std::strerror(errno));
+        }
+    } else {
+        addrinfo* info = resolve(address, true);
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        bool bound = fd >= 0 && bind(fd, info->ai_addr, info->ai_addrlen) == 0;
+        freeaddrinfo(info);
+        if (!bound) {
+            throw std::runtime_error("Could not bind to " + address + ": " + std::strerror(errno));
+        }
+    }
+
+    if (listen(fd, SOMAXCONN) != 0) {
+        throw std::runtime_error("Could not listen on " + address + ": " + std::strerror(errno));
+    }
+    return fd;
+}
+
+int connectTo(const std::string& address) {
+    // The coordinator may not be listening yet when workers are started by hand
+    constexpr int nAttempts = 50;
+    for (int attempt = 0; attempt < nAttempts; ++attempt) {
+        int fd = -1;
+        bool connected = false;
+        if (isUnixSocketPath(address)) {
+            sockaddr_un addr = unixSocketAddress(address);
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            connected =
+                fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        } else {
+            addrinfo* info = resolve(address, false);
+            fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+            connected = fd >= 0 && connect(fd, info->ai_addr, info->ai_addrlen) == 0;
+            freeaddrinfo(info);
+        }
+        if (connected) {
+            return fd;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    throw std::runtime_error("Could not connect to coordinator at " + address);
+}
+
+std::size_t tilePixelCount(const Tile& tile) {
+    return static_cast<std::size_t>(tile.x1 - tile.x0) *
+           static_cast<std::size_t>(tile.y1 - tile.y0);
+}
+
+/* The per-pixel sums of the samples rendered by the worker, and the final sample counts. */
+std::vector<unsigned char> serializeTile(const Accumulator& accumulator) {
+    std::vector<unsigned char> bytes(accumulator.samples.pixels.size() * PIXEL_SIZE);
+    unsigned char* out = bytes.data();
+    float sums[Accumulator::FLOATS_PER_PIXEL];
+    for (std::size_t i = 0; i < accumulator.samples.pixels.size(); ++i) {
+        const auto samples = static_cast<int32_t>(accumulator.samples.pixels[i]);
+        accumulator.getPixelSums(i, sums);
+        std::memcpy(out, &samples, sizeof(samples));
+        std::memcpy(out + sizeof(samples), sums, sizeof(sums));
+        out += PIXEL_SIZE;
+    }
+    return bytes;
+}
+
+void mergeTile(const std::vector<unsigned char>& bytes, const Tile& tile,
+               Accumulator& accumulator) {
+    const unsigned char* in = bytes.data();
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        for (int x = tile.x0; x < tile.x1; ++x) {
+            int32_t samples;
+            float sums[Accumulator::FLOATS_PER_PIXEL];
+            std::memcpy(&samples, in, sizeof(samples));
+            std::memcpy(sums, in + sizeof(samples), sizeof(sums));
+            in += PIXEL_SIZE;
+
+            const int ax = x - accumulator.x0;
+            const int ay = y - accumulator.y0;
+            accumulator.samples(ax, ay) = samples;
+            accumulator.addPixelSums(static_cast<std::size_t>(ay) * accumulator.width() + ax, sums);
+        }
+    }
+}
+
+struct WorkerConnection {
+    int fd;
+    int tileIndex = NO_MORE_TILES;
+};
+} // namespace
+
+RenderResult rayTraceDistributed(const PerspectiveCamera& camera, const Scene& scene,
+                                 const RenderParams& params, const std::string& address,
+                                 int nLocalWorkers) {
+    Accumulator accumulator = loadOrCreateAccumulator(params);
+    const std::vector<Tile> tiles = makeTiles(params.region(), params.tileSize);
+
+    std::deque<int> pendingTiles;
+    for (int i = 0; i < static_cast<int>(tiles.size()); ++i) {
+        if (accumulator.samples(tiles[i].x0 - accumulator.x0, tiles[i].y0 - accumulator.y0) <
+            params.nSamples) {
+            pendingTiles.push_back(i);
+        }
+    }
+    const std::size_t nTilesToRender = pendingTiles.size();
+    std::size_t nTilesDone = 0;
+
+    const int listenFd = listenOn(address);
+
+    std::vector<pid_t> localWorkers;
+    for (int i = 0; i < nLocalWorkers; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            throw std::runtime_error(std::string("Could not fork worker: ") + std::strerror(errno));
+        }
+        if (pid == 0) {
+            close(listenFd);
+            // Local workers share the cores of this machine, so they can't pin their threads to
+            // the same CPUs
+            const int nThreads =
+                makeThreadLayout(params.threadPolicy.withEnvironmentOverrides()).nThreads;
+            setenv("RAYTRACER_THREADS",
+                   std::to_string(std::max(1, nThreads / nLocalWorkers)).c_str(), 1);
+            setenv("RAYTRACER_PIN", "0", 1);
+            setenv("RAYTRACER_NUMA", "0", 1);
+            int status = 0;
+            try {
+                runWorker(camera, scene, params, address);
+            } catch (const std::exception& e) {
+                std::cerr << "Worker " << getpid() << " failed: " << e.what() << std::endl;
+                status = 1;
+            }
+            _exit(status);
+        }
+        localWorkers.push_back(pid);
+    }
+
+    std::cout << "Coordinating render on " << address << " with " << nLocalWorkers
+              << " local workers..." << std::endl;
+    const auto start = std::chrono::steady_clock::now();
+    auto lastCheckpoint = start;
+
+    std::vector<WorkerConnection> workers;
+    RenderStats stats;
+    auto assignTile = [&](WorkerConnection& worker) {
+        if (pendingTiles.empty()) {
+            worker.tileIndex = NO_MORE_TILES;
+            return true;
+        }
+        const int tileIndex = pendingTiles.front();
+        const Tile& tile = tiles[tileIndex];
+        const Task task{tileIndex,
+                        accumulator.samples(tile.x0 - accumulator.x0, tile.y0 - accumulator.y0)};
+        if (!sendAll(worker.fd, &task, sizeof(task))) {
+            return false;
+        }
+        pendingTiles.pop_front();
+        worker.tileIndex = tileIndex;
+        return true;
+    };
+    auto dropWorker = [&](std::size_t i) {
+        if (workers[i].tileIndex != NO_MORE_TILES) {
+            pendingTiles.push_front(workers[i].tileIndex);
+        }
+        close(workers[i].fd);
+        workers.erase(workers.begin() + static_cast<std::ptrdiff_t>(i));
+    };
+
+    while (nTilesDone < nTilesToRender) {
+        // Once all the local workers are gone, nothing is left to render the pending tiles unless
+        // workers were started separately : fail instead of waiting forever, so that the render
+        // can be resumed from its checkpoint.
+        localWorkers.erase(std::remove_if(localWorkers.begin(), localWorkers.end(),
+                                          [](pid_t pid) {
+                                              return waitpid(pid, nullptr, WNOHANG) == pid;
+                                          }),
+                           localWorkers.end());
+        if (nLocalWorkers > 0 && localWorkers.empty() && workers.empty()) {
+            close(listenFd);
+            if (isUnixSocketPath(address)) {
+                unlink(address.c_str());
+            }
+            if (!params.checkpointFile.empty()) {
+                saveCheckpoint(accumulator, params.checkpointFile);
+            }
+            throw std::runtime_error(
+                "All workers stopped with " + std::to_string(nTilesToRender - nTilesDone) +
+                " tiles left to render" +
+                (params.checkpointFile.empty() ? "" : ", resume from " + params.checkpointFile));
+        }
+
+        std::vector<pollfd> fds{{listenFd, POLLIN, 0}};
+        for (const auto& worker : workers) {
+            fds.push_back({worker.fd, POLLIN, 0});
+        }
+        // The timeout bounds the time it takes to notice that local workers died
+        if (poll(fds.data(), fds.size(), POLL_TIMEOUT_MS) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+        }
+
+        // Going backwards, since workers can be removed from the list
+        for (std::size_t i = workers.size(); i-- > 0;) {
+            if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            WorkerConnection& worker = workers[i];
+            int32_t tileIndex;
+            if (!receiveAll(worker.fd, &tileIndex, sizeof(tileIndex)) ||
+                tileIndex != worker.tileIndex) {
+                dropWorker(i);
+                continue;
+            }
+            const Tile& tile = tiles[tileIndex];
+            std::vector<unsigned char> bytes(tilePixelCount(tile) * PIXEL_SIZE);
+            RenderStats tileStats;
+            if (!receiveAll(worker.fd, bytes.data(), bytes.size()) ||
+                !receiveAll(worker.fd, &tileStats, sizeof(tileStats))) {
+                dropWorker(i);
+                continue;
+            }
+            {
+                PROFILE_SCOPE("merge tile", tileIndex);
+                mergeTile(bytes, tile, accumulator);
+            }
+            stats += tileStats;
+            worker.tileIndex = NO_MORE_TILES;
+            ++nTilesDone;
+            std::cout << '\r'
+                      << progressBar(static_cast<float>(nTilesDone) /
+                                     static_cast<float>(nTilesToRender))
+                      << std::flush;
+
+            if (!assignTile(worker)) {
+                dropWorker(i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            Hello hello{};
+            if (fd >= 0 && receiveAll(fd, &hello, sizeof(hello)) && hello == makeHello(params)) {
+                workers.push_back({fd});
+                if (!assignTile(workers.back())) {
+                    dropWorker(workers.size() - 1);
+                }
+            } else if (fd >= 0) {
+                std::cerr << "\nRejected a worker with different render parameters" << std::endl;
+                close(fd);
+            }
+        }
+
+        // Tiles of dropped workers go to idle ones
+        for (std::size_t i = workers.size(); i-- > 0;) {
+            if (workers[i].tileIndex == NO_MORE_TILES && !pendingTiles.empty() &&
+                !assignTile(workers[i])) {
+                dropWorker(i);
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (!params.checkpointFile.empty() &&
+            std::chrono::duration<float>(now - lastCheckpoint).count() >=
+                params.checkpointInterval) {
+            saveCheckpoint(accumulator, params.checkpointFile);
+            lastCheckpoint = now;
+        }
+    }
+
+    for (const auto& worker : workers) {
+        const Task done{NO_MORE_TILES, 0};
+        sendAll(worker.fd, &done, sizeof(done));
+        close(worker.fd);
+    }
+    close(listenFd);
+    if (isUnixSocketPath(address)) {
+        unlink(address.c_str());
+    }
+    for (pid_t pid : localWorkers) {
+        waitpid(pid, nullptr, 0);
+    }
+
+    if (!params.checkpointFile.empty()) {
+        saveCheckpoint(accumulator, params.checkpointFile);
+    }
+
+    const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << "\nScene rendered in " << static_cast<float>(duration.count()) / 1000.0f
+              << " seconds.\n";
+
+    RenderResult render(params.width, params.height);
+    render.paste(accumulator.resolve(), accumulator.x0, accumulator.y0);
+    render.stats = stats;
+    render.stats.renderSeconds = static_cast<double>(duration.count()) / 1000.0;
+    render.stats.threads = nLocalWorkers;
+    return render;
+}
+
+void runWorker(const PerspectiveCamera& camera, const Scene& scene, const RenderParams& params,
+               const std::string& address) {
+    const int fd = connectTo(address);
+    const Hello hello = makeHello(params);
+    if (!sendAll(fd, &hello, sizeof(hello))) {
+        close(fd);
+        throw std::runtime_error("Lost connection to coordinator at " + address);
+    }
+
+    const ThreadPolicy policy = params.threadPolicy.withEnvironmentOverrides();
+    const ThreadLayout layout = makeThreadLayout(policy);
+#if defined(_OPENMP)
+    const int num_threads = layout.nThreads;
+    omp_set_num_threads(num_threads);
+    if (policy.pinThreads || policy.numaAware) {
+#pragma omp parallel
+        pinCurrentThread(layout.cpuOfThread[omp_get_thread_num()]);
+    }
+#else
+    const int num_threads = 1;
+#endif
+    // Each tile is split in sub-tiles shared by the threads of the worker like the tiles of a
+    // local render (banded by NUMA node if numaAware is set), small enough to keep them all busy
+    // until the end of the tile. Pixels are seeded independently, so the split doesn't change
+    // the result.
+    const int subTileSize = std::max(
+        4, params.tileSize / static_cast<int>(std::ceil(std::sqrt(4.0f * num_threads))));
+
+    const std::vector<Tile> tiles = makeTiles(params.region(), params.tileSize);
+    Task task{};
+    while (receiveAll(fd, &task, sizeof(task)) && task.tileIndex != NO_MORE_TILES) {
+        if (task.tileIndex < 0 || task.tileIndex >= static_cast<int32_t>(tiles.size())) {
+            break;
+        }
+        const Tile& tile = tiles[task.tileIndex];
+        Accumulator accumulator(tile.x1 - tile.x0, tile.y1 - tile.y0, params.seed, tile.x0,
+                                tile.y0);
+        std::fill(accumulator.samples.pixels.begin(), accumulator.samples.pixels.end(),
+                  task.startSamples);
+
+        const std::vector<Tile> subTiles = makeTiles(tile, subTileSize);
+        const int nColumns = (tile.width() + subTileSize - 1) / subTileSize;
+        const int nRows = (tile.height() + subTileSize - 1) / subTileSize;
+        TileScheduler scheduler(nRows, nColumns, layout, policy.numaAware);
+        std::vector<RenderStats> threadStats(num_threads);
+#if defined(_OPENMP)
+#pragma omp parallel
+#endif
+        {
+#if defined(_OPENMP)
+            const int thread = omp_get_thread_num();
+#else
+            const int thread = 0;
+#endif
+            for (int i = scheduler.nextTile(thread); i >= 0; i = scheduler.nextTile(thread)) {
+                renderTilePasses(camera, scene, params, subTiles[i], accumulator,
+                                 threadStats[thread]);
+            }
+        }
+        RenderStats stats;
+        for (const RenderStats& threadStat : threadStats) {
+            stats += threadStat;
+        }
+
+        const std::vector<unsigned char> bytes = serializeTile(accumulator);
+        if (!sendAll(fd, &task.tileIndex, sizeof(task.tileIndex)) ||
+            !sendAll(fd, bytes.data(), bytes.size()) || !sendAll(fd, &stats, sizeof(stats))) {
+            break;
+        }
+    }
+    close(fd);
+}
@@ -0,0 +1,30 @@
+#ifndef DISTRIBUTED_HPP
+#define DISTRIBUTED_HPP
+
+#include "camera.hpp"
+#include "params.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+#include <string>
+
+/* Distributed rendering : a coordinator process hands out tiles to worker processes, which
+   render them with their own copy of the scene and send back their accumulation buffers.
+   Addresses are either a Unix socket path (e.g. /tmp/raytracer.sock), or host:port for TCP
+   so that workers can run on other machines. Tiles are rendered exactly like with rayTrace, so
+   both give the same image. */
+
+/* Forks nLocalWorkers worker processes, which share the threads of this machine, and also
+   accepts workers started separately with runWorker. Tiles of workers that disconnect are handed
+   out again. Throws (after saving the checkpoint, if any) if all the local workers stop while
+   tiles are left and no other worker is connected. */
+RenderResult rayTraceDistributed(const PerspectiveCamera& camera, const Scene& scene,
+                                 const RenderParams& params, const std::string& address,
+                                 int nLocalWorkers);
+
+/* Renders the tiles sent by the coordinator until there are none left, each with all the threads
+   given by params.threadPolicy. The scene and parameters must be the same as the coordinator's,
+   which refuses workers with different parameters. */
+void runWorker(const PerspectiveCamera& camera, const Scene& scene, const RenderParams& params,
+               const std::string& address);
+
+#endif
@@ -0,0 +1,62 @@
+#include "environment.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+EnvironmentMap::EnvironmentMap(Framebuffer image, float intensity, float rotation)
+    : image(std::move(image)), rotation(rotation) {
+    Framebuffer& map = this->image;
+    std::vector<float> rowWeights(map.height);
+    std::vector<float> pixelWeights(map.width);
+    columns.reserve(map.height);
+    for (int y = 0; y < map.height; ++y) {
+        // The pixels of a row all cover the same solid angle, which shrinks towards the poles
+        const float sinTheta = std::sin(Utils::PI * (static_cast<float>(y) + 0.5f) /
+                                        static_cast<float>(map.height));
+        float rowWeight = 0.0f;
+        for (int x = 0; x < map.width; ++x) {
+            map(x, y) = map(x, y) * intensity;
+            pixelWeights[x] = std::max(map(x, y).luminance(), 0.0f);
+            rowWeight += pixelWeights[x];
+        }
+        rowWeights[y] = rowWeight * sinTheta;
+        columns.emplace_back(pixelWeights);
+    }
+    rows = AliasTable(rowWeights);
+}
+
+Color EnvironmentMap::lookup(const Vector3& direction) const {
+    const float phi = std::atan2(direction.x, -direction.z) + rotation;
+    float u = phi / Utils::TWO_PI + 0.5f;
+    u -= std::floor(u);
+    const float v = std::acos(std::clamp(direction.y, -1.0f, 1.0f)) / Utils::PI;
+    const int x = std::min(static_cast<int>(u * static_cast<float>(image.width)), image.width - 1);
+    const int y =
+        std::min(static_cast<int>(v * static_cast<float>(image.height)), image.height - 1);
+    return image(x, y);
+}
+
+EnvironmentMap::Sample EnvironmentMap::sample() const {
+    const std::size_t row = rows.sample(Utils::random());
+    const std::size_t column = columns[row].sample(Utils::random());
+    const int x = static_cast<int>(column);
+    const int y = static_cast<int>(row);
+
+    // Uniform within the pixel, in (u, v)
+    const float u = (static_cast<float>(x) + Utils::random()) / static_cast<float>(image.width);
+    const float v = (static_cast<float>(y) + Utils::random()) / static_cast<float>(image.height);
+    const float theta = Utils::PI * v;
+    const float phi = Utils::TWO_PI * (u - 0.5f) - rotation;
+    const float sinTheta = std::sin(theta);
+    const Vector3 direction(sinTheta * std::sin(phi), std::cos(theta), -sinTheta * std::cos(phi));
+
+    // The image covers 2 pi x pi radians, and a solid angle element is sin(theta) dtheta dphi
+    const float pixelPmf = rows.pmf(row) * columns[row].pmf(column);
+    const float pdf = sinTheta > 0.0f ? pixelPmf * static_cast<float>(image.width) *
+                                            static_cast<float>(image.height) /
+                                            (2.0f * Utils::PI * Utils::PI * sinTheta)
+                                      : 0.0f;
+    return {direction, image(x, y), pdf};
+}
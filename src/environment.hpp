@@ -0,0 +1,39 @@
+#ifndef ENVIRONMENT_HPP
+#define ENVIRONMENT_HPP
+
+#include "color.hpp"
+#include "framebuffer.hpp"
+#include "lightsampler.hpp"
+#include "vector3.hpp"
+#include <vector>
+
+/* Radiance coming from infinitely far away, read from a latitude-longitude HDR image : its rows
+   go from straight up (+y) to straight down, and its columns around the y axis, the center of the
+   image facing -z. rotation (in radians) turns the map around the y axis.
+   It is importance sampled as a light : a pixel is picked with a probability proportional to its
+   luminance times the solid angle it covers, first its row from the marginal distribution of the
+   rows, then its column from the distribution of that row. Both are alias tables, so a sample
+   costs O(1) whatever the size of the map. */
+class EnvironmentMap {
+    Framebuffer image;
+    float rotation;
+    AliasTable rows;
+    std::vector<AliasTable> columns;
+
+  public:
+    struct Sample {
+        Vector3 direction;
+        Color radiance;
+        // With respect to solid angle
+        float pdf;
+    };
+
+    explicit EnvironmentMap(Framebuffer image, float intensity = 1.0f, float rotation = 0.0f);
+
+    /* Radiance of the nearest pixel in that (normalized) direction. */
+    Color lookup(const Vector3& direction) const;
+    /* A direction sampled in proportion to the radiance coming from it. */
+    Sample sample() const;
+};
+
+#endif
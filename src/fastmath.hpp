@@ -0,0 +1,152 @@
+#ifndef FASTMATH_HPP
+#define FASTMATH_HPP
+
+#include "utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* Branchless approximations of the transcendental functions used in hot code, which the
+   compiler can inline and vectorize. The functions without the Approx suffix are the ones the
+   renderer calls : they use the approximations when built with -DFAST_MATH=ON, and the
+   standard library otherwise. Error bounds were measured over the given ranges. */
+namespace FastMath {
+namespace detail {
+// PI split in two floats, so that range reduction keeps full precision (Cody-Waite)
+constexpr float PI_HIGH = 3.14159274101257324f;
+constexpr float PI_LOW = -8.74227766e-8f;
+constexpr float INV_PI = 0.318309886183790672f;
+constexpr float HALF_PI = 1.57079632679489662f;
+constexpr float LOG2_E = 1.44269504088896341f;
+
+inline float fromBits(uint32_t bits) {
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint32_t toBits(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+} // namespace detail
+
+/* Absolute error < 2e-7 on [-2 PI, 2 PI], growing with |x| to 4e-6 at |x| = 100. */
+inline float sinApprox(float x) {
+    // x = k * PI + r, with r in [-PI/2, PI/2] and sin(x) = (-1)^k * sin(r)
+    const float k = std::floor(x * detail::INV_PI + 0.5f);
+    const float r = (x - k * detail::PI_HIGH) - k * detail::PI_LOW;
+    const float r2 = r * r;
+    // Taylor series up to r^11, whose remainder is below 6e-8 on [-PI/2, PI/2]
+    const float s =
+        r + r * r2 *
+                (-1.66666667e-1f +
+                 r2 * (8.33333333e-3f +
+                       r2 * (-1.98412698e-4f + r2 * (2.75573192e-6f + r2 * -2.50521084e-8f))));
+    return (static_cast<int>(k) & 1) ? -s : s;
+}
+
+/* Absolute error < 3e-7 on [-2 PI, 2 PI]. */
+inline float cosApprox(float x) { return sinApprox(x + detail::HALF_PI); }
+
+/* Relative error < 2.5e-7. Results are clamped to [2^-126, 2^128) instead of going subnormal or
+   infinite. */
+inline float exp2Approx(float x) {
+    x = std::clamp(x, -126.0f, 127.0f);
+    // x = i + f, with f in [-0.5, 0.5]
+    const float i = std::floor(x + 0.5f);
+    const float f = x - i;
+    // Taylor series of 2^f = e^(f * ln(2)) up to f^6, whose remainder is below 1.3e-7
+    const float p =
+        1.0f +
+        f * (6.93147181e-1f +
+             f * (2.40226507e-1f +
+                  f * (5.55041087e-2f +
+                       f * (9.61812911e-3f + f * (1.33335581e-3f + f * 1.54035304e-4f)))));
+    const float scale = detail::fromBits(static_cast<uint32_t>(static_cast<int>(i) + 127) << 23);
+    return p * scale;
+}
+
+/* Same bounds as exp2Approx. */
+inline float expApprox(float x) { return exp2Approx(x * detail::LOG2_E); }
+
+/* Absolute error < 2e-7 on [1/4, 4], and otherwise within a few float ulps of the result.
+   For positive normal floats only. */
+inline float log2Approx(float x) {
+    const uint32_t bits = detail::toBits(x);
+    float exponent = static_cast<float>(static_cast<int>(bits >> 23) - 127);
+    // Mantissa m in [1, 2), brought back to [sqrt(2) / 2, sqrt(2)] so that s stays small
+    float m = detail::fromBits((bits & 0x007FFFFFu) | 0x3F800000u);
+    const bool high = m > 1.41421356f;
+    m = high ? 0.5f * m : m;
+    exponent = high ? exponent + 1.0f : exponent;
+    // log2(m) = 2 / ln(2) * atanh(s), with s = (m - 1) / (m + 1) in [-0.172, 0.172]
+    const float s = (m - 1.0f) / (m + 1.0f);
+    const float s2 = s * s;
+    return exponent +
+           s * (2.88539008f +
+                s2 * (9.61796694e-1f + s2 * (5.77078016e-1f + s2 * 4.12198583e-1f)));
+}
+
+/* For x >= 0 and y > 0. The relative error grows with |y * log2(x)|, and is below 1e-5 for
+   results between 1e-12 and 1e12. */
+inline float powApprox(float x, float y) {
+    return x > 0.0f ? exp2Approx(y * log2Approx(x)) : 0.0f;
+}
+
+#if defined(RAYTRACER_FAST_MATH)
+inline float sin(float x) { return sinApprox(x); }
+inline float cos(float x) { return cosApprox(x); }
+inline float exp(float x) { return expApprox(x); }
+inline float exp2(float x) { return exp2Approx(x); }
+inline float log2(float x) { return log2Approx(x); }
+inline float pow(float x, float y) { return powApprox(x, y); }
+#else
+inline float sin(float x) { return std::sin(x); }
+inline float cos(float x) { return std::cos(x); }
+inline float exp(float x) { return std::exp(x); }
+inline float exp2(float x) { return std::exp2(x); }
+inline float log2(float x) { return std::log2(x); }
+inline float pow(float x, float y) { return std::pow(x, y); }
+#endif
+
+/* x^(1 / gamma) for x in [0, 1]. With fast math, it is interpolated from a table sampled
+   uniformly in x^(1/4), where the curve is smooth : the absolute error is below 1e-6 for gammas
+   between 1.8 and 2.6, far below the 8-bit quantization step. */
+class GammaCurve {
+    float exponent;
+#if defined(RAYTRACER_FAST_MATH)
+    constexpr static int N_SEGMENTS = 1024;
+    std::vector<float> table;
+#endif
+
+  public:
+    explicit GammaCurve(float gamma) : exponent(1.0f / gamma) {
+#if defined(RAYTRACER_FAST_MATH)
+        table.resize(N_SEGMENTS + 2);
+        for (int i = 0; i <= N_SEGMENTS; ++i) {
+            const float u = static_cast<float>(i) / N_SEGMENTS;
+            table[i] = std::pow(Utils::sqr(Utils::sqr(u)), exponent);
+        }
+        // Padding, so that x = 1 can be interpolated without a branch
+        table[N_SEGMENTS + 1] = table[N_SEGMENTS];
+#endif
+    }
+
+    float operator()(float x) const {
+#if defined(RAYTRACER_FAST_MATH)
+        const float u = std::sqrt(std::sqrt(std::clamp(x, 0.0f, 1.0f))) * N_SEGMENTS;
+        const int i = static_cast<int>(u);
+        const float t = u - static_cast<float>(i);
+        return table[i] + t * (table[i + 1] - table[i]);
+#else
+        return std::pow(x, exponent);
+#endif
+    }
+};
+} // namespace FastMath
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include "color.hpp"
+#include "vector3.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/* Allocator which leaves the elements constructed without arguments uninitialized, so that
+   their memory pages are only touched (and thus placed on a NUMA node) by the thread which
+   first writes to them. Only meant for trivially destructible types. */
+template <typename T> struct UninitializedAllocator {
+    using value_type = T;
+
+    UninitializedAllocator() = default;
+    template <typename U> UninitializedAllocator(const UninitializedAllocator<U>&) {}
+
+    T* allocate(std::size_t n) { return std::allocator<T>().allocate(n); }
+    void deallocate(T* p, std::size_t n) { std::allocator<T>().deallocate(p, n); }
+
+    template <typename U> void construct(U*) noexcept {}
+    template <typename U, typename... Args> void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U> bool operator==(const UninitializedAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const UninitializedAllocator<U>&) const { return false; }
+};
+
+/* Tag to construct a buffer without initializing its pixels. */
+struct Uninitialized {};
+
+/* A width x height image, stored row by row in a single contiguous array. */
+template <typename T, typename Allocator = std::allocator<T>> struct Buffer2D {
+    int width;
+    int height;
+    std::vector<T, Allocator> pixels;
+
+    Buffer2D(int width, int height, const T& value = T())
+        : width(width), height(height),
+          pixels(static_cast<std::size_t>(width) * static_cast<std::size_t>(height), value) {}
+
+    /* Pixels must be written before being read : only useful with UninitializedAllocator. */
+    Buffer2D(int width, int height, Uninitialized)
+        : width(width), height(height),
+          pixels(static_cast<std::size_t>(width) * static_cast<std::size_t>(height)) {}
+
+    T& operator()(int x, int y) { return pixels[static_cast<std::size_t>(y) * width + x]; }
+    const T& operator()(int x, int y) const {
+        return pixels[static_cast<std::size_t>(y) * width + x];
+    }
+
+    /* Copies other into this buffer, with its top-left pixel at (x0, y0). */
+    template <typename OtherAllocator>
+    void paste(const Buffer2D<T, OtherAllocator>& other, int x0, int y0) {
+        for (int y = 0; y < other.height; ++y) {
+            std::copy(other.pixels.begin() + static_cast<std::size_t>(y) * other.width,
+                      other.pixels.begin() + static_cast<std::size_t>(y + 1) * other.width,
+                      pixels.begin() + static_cast<std::size_t>(y0 + y) * width + x0);
+        }
+    }
+};
+
+using Framebuffer = Buffer2D<Color>;
+using NormalBuffer = Buffer2D<Vector3>;
+using DepthBuffer = Buffer2D<float>;
+using CostBuffer = Buffer2D<float>;
+
+#endif
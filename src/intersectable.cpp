@@ -3,64 +3,167 @@
 #include "ray.hpp"
 #include "sampling.hpp"
 #include "utils.hpp"
+#include <algorithm>
 #include <cmath>
-#include <optional>
+#include <limits>
 
-std::optional<Intersection> Plane::intersect(const Ray& ray) const {
+bool Plane::intersect(Ray& ray, Intersection& hit) const {
     float dDotN{normal.dot(ray.direction)};
 
     if (dDotN == 0.0f) {
-        return {};
+        return false;
     }
 
     const float t = normal.dot(position - ray.origin) / dDotN;
 
     if (!ray.isValidRayDistance(t)) {
-        return {};
+        return false;
     }
 
     bool backFace = dDotN > 0.0f;
 
-    Point3 intersectionLocation = ray.origin + t * ray.direction.normalized();
-    return Intersection(intersectionLocation, backFace ? -normal : normal, t, material, backFace);
+    ray.maxDist = t;
+    hit.location = ray.origin + t * ray.direction;
+    hit.normal = backFace ? -normal : normal;
+    hit.distanceToRayOrigin = t;
+    hit.material = &material;
+    hit.backFace = backFace;
+    return true;
 }
 
-PointSamplingResult Plane::sampleForDirectLighting(const Point3&) const {
+PointSamplingResult Plane::sampleForDirectLighting(const Point3&, float) const {
     assert(false && "Not implemented yet");
     return PointSamplingResult(Point3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 0.0f, 0.0f), 0.0f);
 }
 
-std::optional<Intersection> Sphere::intersect(const Ray& ray) const {
-    // float a = raydirection.lengthSquared() is always equal to 1
-    float a = 1.0f;
-    float b = 2 * ray.direction.dot(ray.origin - center);
-    float c = (ray.origin - center).lengthSquared() - Utils::sqr(radius);
+float Plane::area() const { return std::numeric_limits<float>::infinity(); }
 
-    auto solutions = Utils::solveSecondDegreeEquation(a, b, c);
+BoundingSphere Plane::bounds() const {
+    return {position, std::numeric_limits<float>::infinity()};
+}
+
+void PlaneSet::add(const Plane& plane) {
+    normalX.push_back(plane.normal.x);
+    normalY.push_back(plane.normal.y);
+    normalZ.push_back(plane.normal.z);
+    offset.push_back(plane.normal.dot(plane.position));
+    materials.push_back(plane.material);
+}
 
-    if (!solutions) {
-        return {};
+void PlaneSet::set(std::size_t i, const Plane& plane) {
+    normalX[i] = plane.normal.x;
+    normalY[i] = plane.normal.y;
+    normalZ[i] = plane.normal.z;
+    offset[i] = plane.normal.dot(plane.position);
+    materials[i] = plane.material;
+}
+
+bool PlaneSet::intersect(Ray& ray, Intersection& hit) const {
+    const int nPlanes = static_cast<int>(offset.size());
+    int closest = -1;
+    float closestT = ray.maxDist;
+    // Branchless, so that it vectorizes
+    for (int i = 0; i < nPlanes; ++i) {
+        const float dDotN = normalX[i] * ray.direction.x + normalY[i] * ray.direction.y +
+                            normalZ[i] * ray.direction.z;
+        const float oDotN =
+            normalX[i] * ray.origin.x + normalY[i] * ray.origin.y + normalZ[i] * ray.origin.z;
+        // Planes parallel to the ray give an infinite or NaN t, which fails both comparisons
+        const float t = (offset[i] - oDotN) / dDotN;
+        const bool closer = t > Ray::MIN_RAY_DIST && t < closestT;
+        closestT = closer ? t : closestT;
+        closest = closer ? i : closest;
     }
 
-    float t;
-    bool backFace;
+    if (closest < 0) {
+        return false;
+    }
+
+    const Vector3 normal(normalX[closest], normalY[closest], normalZ[closest]);
+    const bool backFace = normal.dot(ray.direction) > 0.0f;
+    ray.maxDist = closestT;
+    hit.location = ray.origin + closestT * ray.direction;
+    hit.normal = backFace ? -normal : normal;
+    hit.distanceToRayOrigin = closestT;
+    hit.material = &materials[closest];
+    hit.backFace = backFace;
+    return true;
+}
+
+bool Sphere::intersect(Ray& ray, Intersection& hit) const {
+    // Since ray.direction is normalized, the equation is t² + 2 * halfB * t + c = 0
+    const Vector3 centerToOrigin = ray.origin - center;
+    const float halfB = ray.direction.dot(centerToOrigin);
+    const float c = centerToOrigin.lengthSquared() - radiusSquared;
+
+    // The origin is outside of the sphere, which is behind the ray
+    if (c > 0.0f && halfB > 0.0f) {
+        return false;
+    }
+
+    if (alwaysRobust || c > Utils::sqr(DISTANT_SPHERE_RATIO) * radiusSquared) {
+        return intersectRobust(ray, hit, centerToOrigin, halfB, c);
+    }
+
+    const float discriminant = Utils::sqr(halfB) - c;
+    if (discriminant < 0.0f) {
+        return false;
+    }
+
+    // The closest root -halfB - sqrt(discriminant) is beyond maxDist, checked without the sqrt
+    const float beyondMaxDist = -halfB - ray.maxDist;
+    if (beyondMaxDist >= 0.0f && Utils::sqr(beyondMaxDist) >= discriminant) {
+        return false;
+    }
+
+    const float sqrtDiscriminant = std::sqrt(discriminant);
     // since t1 always <= t2, we check t1 first
-    if (ray.isValidRayDistance(solutions->first)) {
-        t = solutions->first;
-        backFace = false;
-    } else if (ray.isValidRayDistance(solutions->second)) {
-        t = solutions->second;
-        backFace = true;
-    } else {
-        return {};
+    const float t1 = -halfB - sqrtDiscriminant;
+    if (ray.isValidRayDistance(t1)) {
+        return recordHit(ray, hit, t1, false);
+    }
+    const float t2 = -halfB + sqrtDiscriminant;
+    if (ray.isValidRayDistance(t2)) {
+        return recordHit(ray, hit, t2, true);
     }
+    return false;
+}
+
+/* From "Precision Improvements for Ray/Sphere Intersection" (Ray Tracing Gems, chapter 7) : the
+   discriminant is computed from the distance between the center and the ray, which doesn't
+   cancel out for distant spheres, and the root closest to the origin as c / q, which doesn't
+   cancel out for large spheres. */
+bool Sphere::intersectRobust(Ray& ray, Intersection& hit, const Vector3& centerToOrigin,
+                             float halfB, float c) const {
+    const Vector3 centerToClosestPoint = centerToOrigin - halfB * ray.direction;
+    const float discriminant = radiusSquared - centerToClosestPoint.lengthSquared();
+    if (discriminant < 0.0f) {
+        return false;
+    }
+
+    const float q = -halfB - std::copysign(std::sqrt(discriminant), halfB);
+    const float t1 = std::min(q, c / q);
+    const float t2 = std::max(q, c / q);
+    if (ray.isValidRayDistance(t1)) {
+        return recordHit(ray, hit, t1, false);
+    }
+    if (ray.isValidRayDistance(t2)) {
+        return recordHit(ray, hit, t2, true);
+    }
+    return false;
+}
 
-    Point3 intersectionLocation = ray.origin + t * ray.direction.normalized();
-    return Intersection(intersectionLocation, (intersectionLocation - center).normalized(), t,
-                        material, backFace);
+bool Sphere::recordHit(Ray& ray, Intersection& hit, float t, bool backFace) const {
+    ray.maxDist = t;
+    hit.location = ray.origin + t * ray.direction;
+    hit.normal = (hit.location - center) * invRadius;
+    hit.distanceToRayOrigin = t;
+    hit.material = &material;
+    hit.backFace = backFace;
+    return true;
 }
 
-PointSamplingResult Sphere::sampleForDirectLighting(const Point3& location) const {
+PointSamplingResult Sphere::sampleForDirectLighting(const Point3& location, float) const {
     Vector3 centerToLocation = location - center;
     float dToCenter = centerToLocation.length();
     float cosThetaMax = radius / dToCenter;
@@ -72,4 +175,210 @@ PointSamplingResult Sphere::sampleForDirectLighting(const Point3& location) cons
 
     // PDF must be divided by R² since we are not on the unit sphere anymore
     return PointSamplingResult(point, normal, sample.pdf / Utils::sqr(radius));
-}
\ No newline at end of file
+}
+Quad::Quad(const Point3& corner, const Vector3& u, const Vector3& v, const Material& material)
+    : Intersectable(material), corner(corner), u(u), v(v), normal(u.cross(v)), w(normal),
+      offset(0.0f), surfaceArea(normal.length()) {
+    w /= normal.lengthSquared();
+    normal /= surfaceArea;
+    offset = normal.dot(corner);
+}
+
+Quad Quad::translated(const Vector3& translation) const {
+    Quad moved = *this;
+    moved.corner += translation;
+    moved.offset = normal.dot(moved.corner);
+    return moved;
+}
+
+float Sphere::area() const { return 4.0f * Utils::PI * radiusSquared; }
+
+BoundingSphere Sphere::bounds() const { return {center, radius}; }
+
+bool Quad::intersect(Ray& ray, Intersection& hit) const {
+    const float dDotN = normal.dot(ray.direction);
+    const float t = (offset - normal.dot(ray.origin)) / dDotN;
+
+    if (!ray.isValidRayDistance(t)) {
+        return false;
+    }
+
+    // Coordinates of the hit in the (u, v) basis, from "Ray Tracing : The Next Week"
+    const Point3 location = ray.origin + t * ray.direction;
+    const Vector3 fromCorner = location - corner;
+    const float alpha = w.dot(fromCorner.cross(v));
+    const float beta = w.dot(u.cross(fromCorner));
+    if (alpha < 0.0f || alpha > 1.0f || beta < 0.0f || beta > 1.0f) {
+        return false;
+    }
+
+    bool backFace = dDotN > 0.0f;
+
+    ray.maxDist = t;
+    hit.location = location;
+    hit.normal = backFace ? -normal : normal;
+    hit.distanceToRayOrigin = t;
+    hit.material = &material;
+    hit.backFace = backFace;
+    return true;
+}
+
+PointSamplingResult Quad::sampleForDirectLighting(const Point3& location, float) const {
+    const float alpha = Utils::random();
+    const float beta = Utils::random();
+    const Point3 point = corner + alpha * u + beta * v;
+    // Quads emit on both sides
+    const Vector3 facingNormal = normal.dot(location - point) >= 0.0f ? normal : -normal;
+
+    return PointSamplingResult(point, facingNormal, 1.0f / surfaceArea);
+}
+
+float Quad::area() const { return surfaceArea; }
+
+BoundingSphere Quad::bounds() const {
+    return {corner + 0.5f * (u + v), 0.5f * std::max((u + v).length(), (u - v).length())};
+}
+
+bool Box::intersect(Ray& ray, Intersection& hit) const {
+    // Slab test : distances at which the ray enters and leaves each pair of faces
+    const float tx0 = (min.x - ray.origin.x) / ray.direction.x;
+    const float tx1 = (max.x - ray.origin.x) / ray.direction.x;
+    const float ty0 = (min.y - ray.origin.y) / ray.direction.y;
+    const float ty1 = (max.y - ray.origin.y) / ray.direction.y;
+    const float tz0 = (min.z - ray.origin.z) / ray.direction.z;
+    const float tz1 = (max.z - ray.origin.z) / ray.direction.z;
+    const float enterX = std::min(tx0, tx1), leaveX = std::max(tx0, tx1);
+    const float enterY = std::min(ty0, ty1), leaveY = std::max(ty0, ty1);
+    const float enterZ = std::min(tz0, tz1), leaveZ = std::max(tz0, tz1);
+    const float tNear = std::max({enterX, enterY, enterZ});
+    const float tFar = std::min({leaveX, leaveY, leaveZ});
+
+    if (tNear > tFar) {
+        return false;
+    }
+
+    float t;
+    bool backFace;
+    if (ray.isValidRayDistance(tNear)) {
+        t = tNear;
+        backFace = false;
+    } else if (ray.isValidRayDistance(tFar)) {
+        t = tFar;
+        backFace = true;
+    } else {
+        return false;
+    }
+
+    // Outward normal of the face hit : faces are entered against the ray direction, and left
+    // along it.
+    const float side = backFace ? 1.0f : -1.0f;
+    const float tX = backFace ? leaveX : enterX;
+    const float tY = backFace ? leaveY : enterY;
+    if (t == tX) {
+        hit.normal = Vector3(std::copysign(side, ray.direction.x), 0.0f, 0.0f);
+    } else if (t == tY) {
+        hit.normal = Vector3(0.0f, std::copysign(side, ray.direction.y), 0.0f);
+    } else {
+        hit.normal = Vector3(0.0f, 0.0f, std::copysign(side, ray.direction.z));
+    }
+
+    ray.maxDist = t;
+    hit.location = ray.origin + t * ray.direction;
+    hit.distanceToRayOrigin = t;
+    hit.material = &material;
+    hit.backFace = backFace;
+    return true;
+}
+
+PointSamplingResult Box::sampleForDirectLighting(const Point3&, float) const {
+    // Uniform sampling of the surface. Faces turned away from the location are occluded by the
+    // box itself, so they don't contribute.
+    const Vector3 size = max - min;
+    const float areaX = size.y * size.z;
+    const float areaY = size.x * size.z;
+    const float areaZ = size.x * size.y;
+    const float halfArea = areaX + areaY + areaZ;
+
+    const float face = Utils::random() * halfArea;
+    const bool maxSide = Utils::random() < 0.5f;
+    const float a = Utils::random();
+    const float b = Utils::random();
+    const float side = maxSide ? 1.0f : -1.0f;
+    Point3 point(0.0f, 0.0f, 0.0f);
+    Vector3 normal(0.0f, 0.0f, 0.0f);
+    if (face < areaX) {
+        point = Point3(maxSide ? max.x : min.x, min.y + a * size.y, min.z + b * size.z);
+        normal = Vector3(side, 0.0f, 0.0f);
+    } else if (face < areaX + areaY) {
+        point = Point3(min.x + a * size.x, maxSide ? max.y : min.y, min.z + b * size.z);
+        normal = Vector3(0.0f, side, 0.0f);
+    } else {
+        point = Point3(min.x + a * size.x, min.y + b * size.y, maxSide ? max.z : min.z);
+        normal = Vector3(0.0f, 0.0f, side);
+    }
+
+    return PointSamplingResult(point, normal, 1.0f / (2.0f * halfArea));
+}
+
+float Box::area() const {
+    const Vector3 size = max - min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+BoundingSphere Box::bounds() const { return {0.5f * (min + max), 0.5f * (max - min).length()}; }
+
+bool MovingSphere::intersect(Ray& ray, Intersection& hit) const {
+    const Vector3 offset = motion * ray.time;
+    Ray movedRay = ray;
+    movedRay.origin -= offset;
+    if (!sphere.intersect(movedRay, hit)) {
+        return false;
+    }
+    ray.maxDist = movedRay.maxDist;
+    hit.location += offset;
+    hit.material = &material;
+    return true;
+}
+
+PointSamplingResult MovingSphere::sampleForDirectLighting(const Point3& location,
+                                                          float time) const {
+    const Vector3 offset = motion * time;
+    PointSamplingResult sample = sphere.sampleForDirectLighting(location - offset, time);
+    sample.point += offset;
+    return sample;
+}
+
+float MovingSphere::area() const { return sphere.area(); }
+
+BoundingSphere MovingSphere::bounds() const {
+    const BoundingSphere start = sphere.bounds();
+    return {start.center + 0.5f * motion, start.radius + 0.5f * motion.length()};
+}
+
+bool Instance::intersect(Ray& ray, Intersection& hit) const {
+    const Vector3 offset = translationAt(ray.time);
+    Ray movedRay = ray;
+    movedRay.origin -= offset;
+    if (!object->intersect(movedRay, hit)) {
+        return false;
+    }
+    ray.maxDist = movedRay.maxDist;
+    hit.location += offset;
+    hit.material = &material;
+    return true;
+}
+
+PointSamplingResult Instance::sampleForDirectLighting(const Point3& location, float time) const {
+    const Vector3 offset = translationAt(time);
+    PointSamplingResult sample = object->sampleForDirectLighting(location - offset, time);
+    sample.point += offset;
+    return sample;
+}
+
+float Instance::area() const { return object->area(); }
+
+BoundingSphere Instance::bounds() const {
+    const BoundingSphere objectBounds = object->bounds();
+    return {objectBounds.center + translation0 + 0.5f * motion,
+            objectBounds.radius + 0.5f * motion.length()};
+}
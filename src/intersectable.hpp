@@ -6,44 +6,223 @@
 #include "ray.hpp"
 #include "sampling.hpp"
 #include "vector3.hpp"
+#include <cstddef>
 #include <memory>
-#include <optional>
+#include <utility>
 #include <vector>
 
+/* Sphere enclosing an object. Unbounded objects have an infinite radius. */
+struct BoundingSphere {
+    Point3 center;
+    float radius;
+};
+
+/* Interface of all scene objects. Scene stores the built-in (final) primitives by value and
+   calls them directly, other implementations go through the virtual calls. */
 class Intersectable {
   public:
     Material material;
 
     Intersectable(const Material& material) : material(material) {}
 
-    virtual std::optional<Intersection> intersect(const Ray& ray) const = 0;
-    virtual PointSamplingResult sampleForDirectLighting(const Point3& location) const = 0;
+    /* If the ray hits this object before ray.maxDist, overwrites hit, shrinks ray.maxDist to the
+       distance of the hit (so that objects further away are rejected early) and returns true. */
+    virtual bool intersect(Ray& ray, Intersection& hit) const = 0;
+    /* Samples a point of the object, as it is at the given time, for a light seen from
+       location. */
+    virtual PointSamplingResult sampleForDirectLighting(const Point3& location,
+                                                        float time) const = 0;
+    /* Surface area, which weighs the power of lights. */
+    virtual float area() const = 0;
+    /* Encloses the object over its whole motion. */
+    virtual BoundingSphere bounds() const = 0;
 };
 
-class Plane : public Intersectable {
+/* Infinite plane. Since it is unbounded, Scene tests all its planes at once in a PlaneSet. */
+class Plane final : public Intersectable {
   private:
     Point3 position;
     Vector3 normal;
 
+    friend class PlaneSet;
+
   public:
     Plane(const Point3& position, const Vector3& normal, const Material& material)
         : Intersectable(material), position(position), normal(normal) {}
 
-    std::optional<Intersection> intersect(const Ray& ray) const override;
-    PointSamplingResult sampleForDirectLighting(const Point3& location) const override;
+    /* Copy of the plane moved by translation, used to animate scenes. */
+    Plane translated(const Vector3& translation) const {
+        Plane moved = *this;
+        moved.position += translation;
+        return moved;
+    }
+
+    bool intersect(Ray& ray, Intersection& hit) const override;
+    PointSamplingResult sampleForDirectLighting(const Point3& location,
+                                                float time) const override;
+    float area() const override;
+    BoundingSphere bounds() const override;
+};
+
+/* The planes of a scene packed in structure of arrays, intersected together by a loop the
+   compiler can vectorize. */
+class PlaneSet {
+    std::vector<float> normalX;
+    std::vector<float> normalY;
+    std::vector<float> normalZ;
+    // Distance of the plane to the origin along its normal
+    std::vector<float> offset;
+    std::vector<Material> materials;
+
+  public:
+    void add(const Plane& plane);
+    /* Replaces the i-th plane, e.g. when it moves. */
+    void set(std::size_t i, const Plane& plane);
+    std::size_t size() const { return offset.size(); }
+
+    /* Same contract as Intersectable::intersect, for the closest of all planes. */
+    bool intersect(Ray& ray, Intersection& hit) const;
 };
 
-class Sphere : public Intersectable {
+class Sphere final : public Intersectable {
   private:
+    // Above this radius, or when the ray origin is further than DISTANT_SPHERE_RATIO radii
+    // away, the fast intersection test loses too much precision.
+    constexpr static float LARGE_SPHERE_RADIUS{100.0f};
+    constexpr static float DISTANT_SPHERE_RATIO{100.0f};
+
     Point3 center;
     float radius;
+    float radiusSquared;
+    float invRadius;
+    bool alwaysRobust;
+
+    bool intersectRobust(Ray& ray, Intersection& hit, const Vector3& centerToOrigin, float halfB,
+                         float c) const;
+    bool recordHit(Ray& ray, Intersection& hit, float t, bool backFace) const;
 
   public:
     Sphere(const Point3& center, float radius, const Material& material)
-        : Intersectable(material), center(center), radius(radius) {}
+        : Intersectable(material), center(center), radius(radius),
+          radiusSquared(radius * radius), invRadius(1.0f / radius),
+          alwaysRobust(radius > LARGE_SPHERE_RADIUS) {}
+
+    Sphere translated(const Vector3& translation) const {
+        Sphere moved = *this;
+        moved.center += translation;
+        return moved;
+    }
+
+    bool intersect(Ray& ray, Intersection& hit) const override;
+    PointSamplingResult sampleForDirectLighting(const Point3& location,
+                                                float time) const override;
+    float area() const override;
+    BoundingSphere bounds() const override;
+};
+
+/* Parallelogram spanned by edges u and v from a corner. Can be used as an area light. */
+class Quad final : public Intersectable {
+  private:
+    Point3 corner;
+    Vector3 u;
+    Vector3 v;
+    Vector3 normal;
+    // normal / |u x v|, which gives the coordinates of a point in the (u, v) basis
+    Vector3 w;
+    float offset;
+    float surfaceArea;
+
+  public:
+    Quad(const Point3& corner, const Vector3& u, const Vector3& v, const Material& material);
+
+    Quad translated(const Vector3& translation) const;
+
+    bool intersect(Ray& ray, Intersection& hit) const override;
+    PointSamplingResult sampleForDirectLighting(const Point3& location,
+                                                float time) const override;
+    float area() const override;
+    BoundingSphere bounds() const override;
+};
+
+/* Axis-aligned box. Like spheres, boxes are closed : normals point outwards and rays leaving
+   the box hit its back faces. */
+class Box final : public Intersectable {
+  private:
+    Point3 min;
+    Point3 max;
+
+  public:
+    Box(const Point3& min, const Point3& max, const Material& material)
+        : Intersectable(material), min(min), max(max) {}
+
+    Box translated(const Vector3& translation) const {
+        Box moved = *this;
+        moved.min += translation;
+        moved.max += translation;
+        return moved;
+    }
+
+    bool intersect(Ray& ray, Intersection& hit) const override;
+    PointSamplingResult sampleForDirectLighting(const Point3& location,
+                                                float time) const override;
+    float area() const override;
+    BoundingSphere bounds() const override;
+};
+
+/* Sphere moving linearly from center0 at time 0 to center1 at time 1, which is blurred along its
+   motion by cameras with an open shutter. Rays are moved back to the frame of the sphere at
+   time 0 instead of moving the sphere. */
+class MovingSphere final : public Intersectable {
+  private:
+    Sphere sphere;
+    Vector3 motion;
+
+  public:
+    MovingSphere(const Point3& center0, const Point3& center1, float radius,
+                 const Material& material)
+        : Intersectable(material), sphere(center0, radius, material), motion(center1 - center0) {}
+
+    MovingSphere translated(const Vector3& translation) const {
+        MovingSphere moved = *this;
+        moved.sphere = sphere.translated(translation);
+        return moved;
+    }
+
+    bool intersect(Ray& ray, Intersection& hit) const override;
+    PointSamplingResult sampleForDirectLighting(const Point3& location,
+                                                float time) const override;
+    float area() const override;
+    BoundingSphere bounds() const override;
+};
+
+/* Any object, translated by translation0 at time 0 and by translation1 at time 1 (linearly in
+   between), e.g. to blur objects which have no moving variant. The object is shared between
+   its instances. */
+class Instance final : public Intersectable {
+  private:
+    std::shared_ptr<const Intersectable> object;
+    Vector3 translation0;
+    Vector3 motion;
+
+    Vector3 translationAt(float time) const { return translation0 + motion * time; }
+
+  public:
+    Instance(std::shared_ptr<const Intersectable> object, const Vector3& translation0,
+             const Vector3& translation1)
+        : Intersectable(object->material), object(std::move(object)), translation0(translation0),
+          motion(translation1 - translation0) {}
+
+    Instance translated(const Vector3& translation) const {
+        Instance moved = *this;
+        moved.translation0 += translation;
+        return moved;
+    }
 
-    std::optional<Intersection> intersect(const Ray& ray) const override;
-    PointSamplingResult sampleForDirectLighting(const Point3& location) const override;
+    bool intersect(Ray& ray, Intersection& hit) const override;
+    PointSamplingResult sampleForDirectLighting(const Point3& location,
+                                                float time) const override;
+    float area() const override;
+    BoundingSphere bounds() const override;
 };
 
 #endif
\ No newline at end of file
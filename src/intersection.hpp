@@ -2,21 +2,17 @@
 #define INTERSECTION_HPP
 
 #include "vector3.hpp"
-#include <functional>
 
 struct Material;
 
+/* Hit record of the closest intersection found so far along a ray, updated in place by
+   Intersectable::intersect. material stays null as long as nothing has been hit. */
 struct Intersection {
-    Point3 location;
-    Vector3 normal;
-    float distanceToRayOrigin;
-    std::reference_wrapper<const Material> material;
-    bool backFace;
-
-    Intersection(Point3 location, const Vector3& normal, float distanceToRayOrigin,
-                 const Material& material, bool backFace)
-        : location(location), normal(normal), distanceToRayOrigin(distanceToRayOrigin),
-          material(std::ref(material)), backFace(backFace) {}
+    Point3 location{0.0f, 0.0f, 0.0f};
+    Vector3 normal{0.0f, 0.0f, 0.0f};
+    float distanceToRayOrigin = 0.0f;
+    const Material* material = nullptr;
+    bool backFace = false;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,131 @@
+#include "lightsampler.hpp"
+#include <algorithm>
+#include <cmath>
+
+AliasTable::AliasTable(const std::vector<float>& weights)
+    : keepProbability(weights.size(), 1.0f), alias(weights.size()), pmfs(weights.size()) {
+    const std::size_t n = weights.size();
+    double total = 0.0;
+    for (float weight : weights) {
+        total += weight;
+    }
+
+    // Probabilities scaled so that the average bin holds 1, split between the bins holding less
+    // (which get an alias to fill them up) and the others
+    std::vector<double> scaled(n);
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+    for (std::size_t i = 0; i < n; ++i) {
+        pmfs[i] = total > 0.0 ? static_cast<float>(weights[i] / total)
+                              : 1.0f / static_cast<float>(n);
+        scaled[i] = total > 0.0 ? weights[i] / total * n : 1.0;
+        alias[i] = static_cast<uint32_t>(i);
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+    while (!small.empty() && !large.empty()) {
+        const uint32_t lesser = small.back();
+        small.pop_back();
+        const uint32_t greater = large.back();
+        keepProbability[lesser] = static_cast<float>(scaled[lesser]);
+        alias[lesser] = greater;
+        scaled[greater] -= 1.0 - scaled[lesser];
+        if (scaled[greater] < 1.0) {
+            large.pop_back();
+            small.push_back(greater);
+        }
+    }
+    // What remains is only 1 up to rounding errors : those bins keep their own index.
+}
+
+std::size_t AliasTable::sample(float u) const {
+    const float scaled = u * static_cast<float>(pmfs.size());
+    const std::size_t bin = std::min(static_cast<std::size_t>(scaled), pmfs.size() - 1);
+    return scaled - static_cast<float>(bin) < keepProbability[bin] ? bin : alias[bin];
+}
+
+LightSampler::LightSampler(const std::vector<Light>& lights, const Point3& sceneMin,
+                           const Point3& sceneMax)
+    : gridMin(sceneMin) {
+    if (lights.empty()) {
+        return;
+    }
+
+    const Vector3 extent(std::max(sceneMax.x - sceneMin.x, 0.0f),
+                         std::max(sceneMax.y - sceneMin.y, 0.0f),
+                         std::max(sceneMax.z - sceneMin.z, 0.0f));
+    const float longest = std::max({extent.x, extent.y, extent.z, 1e-3f});
+    auto cellsAlong = [longest](float length) {
+        return std::max(1, static_cast<int>(std::ceil(RESOLUTION * length / longest)));
+    };
+    cellsX = cellsAlong(extent.x);
+    cellsY = cellsAlong(extent.y);
+    cellsZ = cellsAlong(extent.z);
+    // Flat sides get cells as thick as the longest ones
+    auto cellSizeAlong = [longest](float length, int nCells) {
+        return length > 0.0f ? length / static_cast<float>(nCells) : longest / RESOLUTION;
+    };
+    const Vector3 cellSize(cellSizeAlong(extent.x, cellsX), cellSizeAlong(extent.y, cellsY),
+                           cellSizeAlong(extent.z, cellsZ));
+    invCellSize = Vector3(1.0f / cellSize.x, 1.0f / cellSize.y, 1.0f / cellSize.z);
+    const float halfDiagonal = 0.5f * cellSize.length();
+
+    std::vector<float> weights(lights.size());
+    cells.reserve(static_cast<std::size_t>(cellsX) * cellsY * cellsZ);
+    for (int z = 0; z < cellsZ; ++z) {
+        for (int y = 0; y < cellsY; ++y) {
+            for (int x = 0; x < cellsX; ++x) {
+                const Point3 center =
+                    gridMin + Vector3((static_cast<float>(x) + 0.5f) * cellSize.x,
+                                      (static_cast<float>(y) + 0.5f) * cellSize.y,
+                                      (static_cast<float>(z) + 0.5f) * cellSize.z);
+                for (std::size_t i = 0; i < lights.size(); ++i) {
+                    const BoundingSphere& bounds = lights[i].bounds;
+                    // The distance is bounded below by the size of the cell and of the light,
+                    // which may overlap
+                    const float minDistance = halfDiagonal + bounds.radius;
+                    const float distanceSquared = (bounds.center - center).lengthSquared();
+                    weights[i] =
+                        lights[i].power / std::max(distanceSquared, minDistance * minDistance);
+                }
+                cells.push_back(makeCell(weights));
+            }
+        }
+    }
+}
+
+LightSampler::Cell LightSampler::makeCell(const std::vector<float>& weights) {
+    float total = 0.0f;
+    for (float weight : weights) {
+        total += weight;
+    }
+    Cell cell;
+    std::vector<float> otherWeights;
+    float othersTotal = 0.0f;
+    for (std::size_t i = 0; i < weights.size(); ++i) {
+        if (total > 0.0f && weights[i] >= DOMINANT_SHARE * total) {
+            cell.dominantLights.push_back(static_cast<uint32_t>(i));
+        } else if (weights[i] > 0.0f) {
+            cell.otherLights.push_back(static_cast<uint32_t>(i));
+            otherWeights.push_back(weights[i]);
+            othersTotal += weights[i];
+        }
+    }
+    if (!otherWeights.empty()) {
+        cell.others = AliasTable(otherWeights);
+        cell.othersProbability = std::min(othersTotal / total, 1.0f);
+    }
+    return cell;
+}
+
+const LightSampler::Cell& LightSampler::cellAt(const Point3& location) const {
+    auto cellAlong = [](float offset, float invSize, int nCells) {
+        // Clamped before the conversion, which would overflow for points far away
+        return static_cast<int>(
+            std::clamp(std::floor(offset * invSize), 0.0f, static_cast<float>(nCells - 1)));
+    };
+    const int x = cellAlong(location.x - gridMin.x, invCellSize.x, cellsX);
+    const int y = cellAlong(location.y - gridMin.y, invCellSize.y, cellsY);
+    const int z = cellAlong(location.z - gridMin.z, invCellSize.z, cellsZ);
+    return cells[(static_cast<std::size_t>(z) * cellsY + static_cast<std::size_t>(y)) * cellsX +
+                 static_cast<std::size_t>(x)];
+}
@@ -0,0 +1,97 @@
+#ifndef LIGHTSAMPLER_HPP
+#define LIGHTSAMPLER_HPP
+
+#include "intersectable.hpp"
+#include "vector3.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/* Samples an index with probability proportional to its weight in O(1), with Vose's alias
+   method : each bin of a uniform choice keeps its own index with some probability, and
+   otherwise redirects to its alias. */
+class AliasTable {
+    std::vector<float> keepProbability;
+    std::vector<uint32_t> alias;
+    std::vector<float> pmfs;
+
+  public:
+    AliasTable() = default;
+    /* Weights must be positive. If they are all 0, indices are picked uniformly. */
+    explicit AliasTable(const std::vector<float>& weights);
+
+    std::size_t size() const { return pmfs.size(); }
+    /* u uniform in [0, 1). */
+    std::size_t sample(float u) const;
+    /* The probability of sampling the index. */
+    float pmf(std::size_t i) const { return pmfs[i]; }
+};
+
+/* Selects the lights sampled by next event estimation at a point, from an estimate of the power
+   each one sends there : its power, divided by its squared distance to the point. The lights
+   which dominate that estimate are always sampled, and at most one of the others is, picked in
+   O(1) from an alias table, with a probability equal to their share of the estimate. Dim lights
+   thus only cost a fraction of a shadow ray, and every light with some power keeps a non-zero
+   probability everywhere.
+   The estimates depend on the point : the bounding box of the scene is divided in a grid, each
+   cell having its own selection built from the distances to its center. Points outside of the
+   grid use the closest cell. */
+class LightSampler {
+  public:
+    struct Light {
+        // Emitted radiance times area, or any quantity proportional to the emitted power
+        float power;
+        BoundingSphere bounds;
+    };
+
+  private:
+    // Cells along the longest side of the grid
+    constexpr static int RESOLUTION = 8;
+    // Share of the estimate above which a light is always sampled
+    constexpr static float DOMINANT_SHARE = 0.5f;
+
+    struct Cell {
+        std::vector<uint32_t> dominantLights;
+        std::vector<uint32_t> otherLights;
+        AliasTable others;
+        float othersProbability = 0.0f;
+    };
+
+    Point3 gridMin{0.0f, 0.0f, 0.0f};
+    Vector3 invCellSize{0.0f, 0.0f, 0.0f};
+    int cellsX = 0;
+    int cellsY = 0;
+    int cellsZ = 0;
+    std::vector<Cell> cells;
+
+    static Cell makeCell(const std::vector<float>& weights);
+    const Cell& cellAt(const Point3& location) const;
+
+  public:
+    LightSampler() = default;
+    /* The grid covers [sceneMin, sceneMax]. Unbounded lights are never picked. */
+    LightSampler(const std::vector<Light>& lights, const Point3& sceneMin, const Point3& sceneMax);
+
+    bool empty() const { return cells.empty(); }
+
+    /* Calls sampleLight(index, probability) for each light selected at location, with the
+       probability it had to be selected. u is uniform in [0, 1). Selects nothing if there are
+       no lights. */
+    template <typename LightSampling>
+    void forEachSelectedLight(const Point3& location, float u, LightSampling sampleLight) const {
+        if (empty()) {
+            return;
+        }
+        const Cell& cell = cellAt(location);
+        for (uint32_t light : cell.dominantLights) {
+            sampleLight(light, 1.0f);
+        }
+        if (u < cell.othersProbability) {
+            const std::size_t i = cell.others.sample(u / cell.othersProbability);
+            sampleLight(cell.otherLights[i], cell.othersProbability * cell.others.pmf(i));
+        }
+    }
+};
+
+#endif
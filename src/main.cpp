@@ -1,16 +1,90 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 
+#include "animation.hpp"
 #include "camera.hpp"
+#include "denoise.hpp"
+#include "distributed.hpp"
+#include "environment.hpp"
 #include "intersectable.hpp"
 #include "material.hpp"
+#include "preview.hpp"
+#include "profiler.hpp"
 #include "save_render.hpp"
 #include "scene.hpp"
+#include "tonemap.hpp"
 #include "trace.hpp"
 #include "utils.hpp"
 #include "vector3.hpp"
 
-int main() {
+int main(int argc, char* argv[]) {
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    auto hasFlag = [&args](const std::string& flag) {
+        return std::find(args.begin(), args.end(), flag) != args.end();
+    };
+    // Returns the n-th argument following the flag, or an empty string if there is none. The
+    // arguments of a flag stop at the next flag.
+    auto option = [&args](const std::string& flag, std::ptrdiff_t n = 1) {
+        auto it = std::find(args.begin(), args.end(), flag);
+        if (it == args.end() || args.end() - it <= n) {
+            return std::string();
+        }
+        for (auto arg = it + 1; arg <= it + n; ++arg) {
+            if (arg->rfind("--", 0) == 0) {
+                return std::string();
+            }
+        }
+        return *(it + n);
+    };
+    // Parses the n-th argument following the flag as a number of the type of fallback, which is
+    // returned if there is no such argument. Malformed numbers end the program.
+    auto numberOption = [&option](const std::string& flag, std::ptrdiff_t n, auto fallback) {
+        const std::string value = option(flag, n);
+        if (value.empty()) {
+            return fallback;
+        }
+        std::istringstream stream(value);
+        decltype(fallback) number{};
+        if (!(stream >> number) || !stream.eof()) {
+            std::cerr << "Invalid argument for " << flag << ": " << value << '\n';
+            std::exit(1);
+        }
+        return number;
+    };
+    // Reads the rectangles "x0 y0 x1 y1" following the n-th argument after the flag
+    auto rectangles = [&option, &numberOption](const std::string& flag, std::ptrdiff_t n = 0) {
+        std::vector<PixelRect> rects;
+        while (!option(flag, n + 4).empty()) {
+            rects.push_back({numberOption(flag, n + 1, 0), numberOption(flag, n + 2, 0),
+                             numberOption(flag, n + 3, 0), numberOption(flag, n + 4, 0)});
+            n += 4;
+        }
+        return rects;
+    };
+
+    ToneMapParams toneMapping;
+    toneMapping.exposure = 0.0f;
+    toneMapping.toneMapOperator = ToneMapOperator::Clamp;
+    // Use PNGCompression::Store (or a .ppm/.bmp output) for quick previews
+    PNGEncodeSettings pngSettings;
+    pngSettings.compression = PNGCompression::Default;
+
+    // Re-exposing a previous render doesn't require rendering it again :
+    // ./raytracer --tonemap test.pfm <exposure>
+    if (!option("--tonemap").empty()) {
+        toneMapping.exposure = numberOption("--tonemap", 2, toneMapping.exposure);
+        saveRenderToPNG(tonemap(loadRenderFromPFM(option("--tonemap")), toneMapping), "test.png",
+                        pngSettings);
+        return 0;
+    }
+
     Material wallMat{Material::Diffuse(Color(0.9f))};
     std::vector<std::shared_ptr<Intersectable>> shapes{
         std::make_shared<Plane>(Point3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0, 0.0f), // floor
@@ -46,14 +120,133 @@ int main() {
     int spp = 40;
     bool nextEventEstimation = true;
     bool firefliesClamping = true;
+    bool denoising = false;
+    bool saveFeatureBuffers = false;
+    bool saveHDR = true;
+    bool saveStats = true;
+    // Records the cost of each pixel, to spot the expensive parts of the scene
+    PixelCost pixelCost = PixelCost::NoCost;
     RenderParams params{width, height, maxBounces, spp, nextEventEstimation, firefliesClamping};
+    // Long renders can be checkpointed with : ./raytracer --checkpoint [file]
+    // and continued after an interruption with : ./raytracer --resume [file]
+    // The checkpoint is removed once the render is saved.
+    if (hasFlag("--checkpoint") || hasFlag("--resume")) {
+        const std::string file =
+            option("--checkpoint").empty() ? option("--resume") : option("--checkpoint");
+        params.checkpointFile = file.empty() ? "test.checkpoint" : file;
+    }
+    params.checkpointInterval = 300.0f;
+    params.resume = hasFlag("--resume");
+    params.pixelCost = pixelCost;
+    // Only renders a rectangle of the frame : ./raytracer --crop x0 y0 x1 y1
+    if (!option("--crop").empty()) {
+        params.cropWindow = rectangles("--crop").at(0);
+    }
+
+    const Color skyColor = Color::BLACK;
+    const CameraSettings cameraSettings{Point3(0.0f, 2.0f, -2.0f), Point3(0.0f, 1.5f, -7.0f),
+                                        Utils::PI / 4};
+
+    // Interactive preview, controlled from stdin or a Unix socket (see preview.hpp) :
+    // ./raytracer --preview [socket path]
+    if (hasFlag("--preview")) {
+        runPreview(shapes, lights, skyColor, cameraSettings, params, toneMapping, "preview.bmp",
+                   option("--preview"));
+        return 0;
+    }
+
+    Scene scene{shapes, lights, params, skyColor};
+    // Lights the scene with a latitude-longitude HDR image instead of skyColor :
+    // ./raytracer --environment sky.hdr [intensity] [rotation in degrees]
+    if (!option("--environment").empty()) {
+        const float intensity = numberOption("--environment", 2, 1.0f);
+        const float rotation = numberOption("--environment", 3, 0.0f) * Utils::PI / 180.0f;
+        scene.environment = std::make_shared<EnvironmentMap>(loadRender(option("--environment")),
+                                                             intensity, rotation);
+    }
+
+    const PerspectiveCamera camera = cameraSettings.makeCamera();
+
+    // Animation, saved to frame_0000.png, frame_0001.png... :
+    // ./raytracer --sequence <number of frames> [first frame]
+    if (!option("--sequence").empty()) {
+        Animation animation;
+        // The camera flies down towards the spheres, while the glass sphere bounces twice
+        animation.cameraLocation.addKeyframe(0.0f, Point3(0.0f, 2.0f, -2.0f));
+        animation.cameraLocation.addKeyframe(1.0f, Point3(-0.8f, 1.6f, -3.0f));
+        animation.cameraLocation.addKeyframe(2.0f, Point3(0.6f, 1.2f, -4.0f));
+        Track<Vector3>& glassSphere = animation.objectTranslations[7];
+        for (int bounce = 0; bounce <= 4; ++bounce) {
+            glassSphere.addKeyframe(0.5f * static_cast<float>(bounce),
+                                    Vector3(0.0f, bounce % 2 == 1 ? 1.0f : 0.0f, 0.0f));
+        }
+
+        SequenceParams sequence;
+        sequence.nFrames = numberOption("--sequence", 1, 0);
+        sequence.firstFrame = numberOption("--sequence", 2, 0);
+        sequence.skipExistingFrames = params.resume;
+        renderSequence(cameraSettings, scene, params, animation, sequence, toneMapping,
+                       pngSettings);
+        return 0;
+    }
+
+    // Distributed rendering : ./raytracer --distributed <address> <number of local workers>
+    // Additional workers, possibly on other machines : ./raytracer --worker <address>
+    // Addresses are Unix socket paths (e.g. /tmp/raytracer.sock) or host:port.
+    if (!option("--worker").empty()) {
+        runWorker(camera, scene, params, option("--worker"));
+        return 0;
+    }
+    // Renders again some regions of a previous render, e.g. after changing the objects in them :
+    // ./raytracer --update test.pfm x0 y0 x1 y1 [x0 y0 x1 y1 ...]
+    if (!option("--update").empty()) {
+        RenderResult render(width, height);
+        render.color = loadRenderFromPFM(option("--update"));
+        if (render.color.width != width || render.color.height != height) {
+            std::cerr << option("--update") << " does not match the resolution of the render\n";
+            return 1;
+        }
+        rayTraceRegions(camera, scene, params, rectangles("--update", 1), render);
+        saveRender(tonemap(render.color, toneMapping), "test.png", pngSettings);
+        saveRenderToPFM(render.color, "test.pfm");
+        return 0;
+    }
+
+    auto render = option("--distributed").empty()
+                      ? rayTrace(camera, scene, params)
+                      : rayTraceDistributed(camera, scene, params, option("--distributed"),
+                                            numberOption("--distributed", 2, 0));
+    if (denoising) {
+        render.color = denoise(render);
+    }
+    saveRender(tonemap(render.color, toneMapping), "test.png", pngSettings);
+
+    if (saveHDR) {
+        saveRenderToPFM(render.color, "test.pfm");
+        saveRenderToEXR(render.color, "test.exr");
+    }
+
+    if (pixelCost != PixelCost::NoCost) {
+        saveCostHeatmapToPNG(render.cost, "test_cost.png");
+        saveBufferToPFM(render.cost, "test_cost.pfm");
+    }
 
-    Scene scene{shapes, lights, params, Color::BLACK};
+    // Only written when built with -DPROFILING=ON
+    Profiler::saveChromeTrace("test_trace.json");
 
-    PerspectiveCamera camera{Point3(0.0f, 2.0f, -2.0f), Point3(0.0f, 1.5f, -7.0f), Utils::PI / 4};
+    if (saveStats) {
+        std::ofstream("test_stats.json") << render.stats.toJSON();
+    }
 
-    auto render = rayTrace(camera, scene, params);
-    saveRenderToPNG(render, "test.png");
+    if (saveFeatureBuffers) {
+        saveRenderToPNG(render.albedo, "test_albedo.png");
+        saveNormalsToPNG(render.normal, "test_normal.png");
+        saveDepthToPNG(render.depth, "test_depth.png");
+    }
 
+    // The render is saved : its checkpoint is not needed anymore
+    if (!params.checkpointFile.empty()) {
+        std::filesystem::remove(params.checkpointFile);
+    }
     return 0;
 }
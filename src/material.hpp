@@ -44,6 +44,9 @@ struct Material {
     }
 };
 
+/* The next ray of a path, and its attenuation. Type must be the type of the material hit, which
+   the caller branches on once per hit. Instantiated for every type but Emissive. */
+template <MaterialType Type>
 std::pair<Ray, Color> reflectOrRefract(const Intersection& intersection, const Point3& rayOrigin);
 
 #endif
\ No newline at end of file
@@ -1,6 +1,27 @@
 #ifndef PARAMS_HPP
 #define PARAMS_HPP
 
+#include "threads.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+/* What the per-pixel cost buffer measures : nothing, wall-clock seconds or traced rays. */
+enum PixelCost { NoCost, Time, Rays };
+
+/* The pixels in [x0, x1) x [y0, y1). */
+struct PixelRect {
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+    bool empty() const { return x1 <= x0 || y1 <= y0; }
+};
+
 struct RenderParams {
     int width;
     int height;
@@ -9,13 +30,50 @@ struct RenderParams {
     bool nextEventEstimation;
     // You probably only want to use that if nextEventEstimation is activated
     bool firefliesClamping;
-    float gamma;
+
+    // The frame is rendered in square tiles, by passes of samplesPerPass samples per pixel.
+    int tileSize = 32;
+    int samplesPerPass = 8;
+    // Identical seeds give identical renders
+    uint64_t seed = 0;
+    // Adds the passes of each pixel with compensated summation, so that renders with thousands
+    // of samples per pixel are not biased by float rounding errors. Costs an extra color per
+    // pixel, see bench_accumulation.
+    bool compensatedAccumulation = false;
+
+    // The accumulation buffers are saved to checkpointFile (if not empty) at the end of the first
+    // pass finishing checkpointInterval seconds after the previous checkpoint, and at the end of
+    // the render. With resume, the render continues from the checkpoint file if it exists.
+    std::string checkpointFile;
+    float checkpointInterval = 300.0f;
+    bool resume = false;
+
+    PixelCost pixelCost = PixelCost::NoCost;
+
+    // If not empty, only this rectangle of the frame is rendered. Pixels keep the values they
+    // would have in a full render.
+    PixelRect cropWindow;
+
+    ThreadPolicy threadPolicy;
 
     RenderParams(int width, int height, int maxBounces, int nSamples, bool nextEventEstimation,
-                 bool firefliesClamping, float gamma = 2.2f)
+                 bool firefliesClamping)
         : width(width), height(height), maxBounces(maxBounces), nSamples(nSamples),
-          nextEventEstimation(nextEventEstimation), firefliesClamping(firefliesClamping),
-          gamma(gamma) {}
+          nextEventEstimation(nextEventEstimation), firefliesClamping(firefliesClamping) {}
+
+    /* The rectangle of the frame to render : the crop window clipped to the frame, or the whole
+       frame. */
+    PixelRect region() const {
+        if (cropWindow.empty()) {
+            return {0, 0, width, height};
+        }
+        const PixelRect clipped{std::max(cropWindow.x0, 0), std::max(cropWindow.y0, 0),
+                                std::min(cropWindow.x1, width), std::min(cropWindow.y1, height)};
+        if (clipped.empty()) {
+            throw std::runtime_error("The crop window is outside of the frame");
+        }
+        return clipped;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,433 @@
+#include "preview.hpp"
+#include "accumulator.hpp"
+#include "save_render.hpp"
+#include "scene.hpp"
+#include "threads.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <omp.h>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+/* Everything the commands can change. */
+struct PreviewState {
+    std::vector<std::shared_ptr<Intersectable>> objects;
+    std::vector<std::shared_ptr<Intersectable>> lights;
+    Color skyColor;
+    CameraSettings camera;
+    RenderParams params;
+    ToneMapParams toneMapping;
+};
+
+/* A parsed command, applied by the rendering thread between passes. Returns whether the
+   accumulation must restart. */
+using Edit = std::function<bool(PreviewState&)>;
+
+/* Hands the edits over from the thread reading the commands to the rendering thread. */
+class CommandQueue {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Edit> edits;
+    bool quit = false;
+
+  public:
+    // Set while edits are waiting, so that the rendering thread cancels its pass
+    std::atomic<bool> pending{false};
+
+    void push(Edit edit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        edits.push_back(std::move(edit));
+        pending = true;
+        changed.notify_one();
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        pending = true;
+        changed.notify_one();
+    }
+
+    /* Moves the waiting edits to taken, waiting for some first if wait is set. Returns false
+       once the queue is closed. */
+    bool take(std::vector<Edit>& taken, bool wait) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (wait) {
+            changed.wait(lock, [this] { return quit || !edits.empty(); });
+        }
+        taken = std::move(edits);
+        edits.clear();
+        pending = false;
+        return !quit;
+    }
+};
+
+template <typename T> T readValue(std::istringstream& in, const char* what) {
+    T value;
+    if (!(in >> value)) {
+        throw std::runtime_error(std::string("expected ") + what);
+    }
+    return value;
+}
+
+template <typename T>
+std::optional<T> readOptionalValue(std::istringstream& in, const char* what) {
+    in >> std::ws;
+    if (in.eof()) {
+        return std::nullopt;
+    }
+    return readValue<T>(in, what);
+}
+
+Color readColor(std::istringstream& in) {
+    const auto r = readValue<float>(in, "a red component");
+    const auto g = readValue<float>(in, "a green component");
+    const auto b = readValue<float>(in, "a blue component");
+    if (r < 0.0f || g < 0.0f || b < 0.0f) {
+        throw std::runtime_error("color components must be positive");
+    }
+    return Color(r, g, b);
+}
+
+Material readMaterial(std::istringstream& in) {
+    const auto type = readValue<std::string>(in, "a material type");
+    const Color color = readColor(in);
+    if (type == "diffuse") {
+        return Material::Diffuse(color);
+    }
+    if (type == "metal") {
+        const float smoothness =
+            readOptionalValue<float>(in, "a smoothness").value_or(10'000.0f);
+        if (smoothness < 1.0f) {
+            throw std::runtime_error("the smoothness must be at least 1");
+        }
+        return Material::Metal(color, smoothness);
+    }
+    if (type == "emissive") {
+        const float emission = readOptionalValue<float>(in, "an emission").value_or(1.0f);
+        if (emission < 0.0f) {
+            throw std::runtime_error("the emission must be positive");
+        }
+        return Material::Emissive(color, emission);
+    }
+    if (type == "refractive") {
+        const float IOR = readOptionalValue<float>(in, "an index of refraction").value_or(1.5f);
+        if (IOR <= 0.0f) {
+            throw std::runtime_error("the index of refraction must be positive");
+        }
+        return Material::Refractive(color, IOR);
+    }
+    throw std::runtime_error("unknown material type " + type);
+}
+
+/* Throws a runtime_error describing what is wrong with the command. */
+Edit parseCommand(const std::string& name, std::istringstream& in, int nObjects) {
+    Edit edit;
+    if (name == "camera") {
+        const auto x = readValue<float>(in, "a camera location");
+        const auto y = readValue<float>(in, "a camera location");
+        const auto z = readValue<float>(in, "a camera location");
+        const auto targetX = readValue<float>(in, "a camera target");
+        const auto targetY = readValue<float>(in, "a camera target");
+        const auto targetZ = readValue<float>(in, "a camera target");
+        const std::optional<float> vfov = readOptionalValue<float>(in, "a field of view");
+        const Point3 location(x, y, z);
+        const Point3 target(targetX, targetY, targetZ);
+        if ((target - location).lengthSquared() == 0.0f) {
+            throw std::runtime_error("the camera must not be on its target");
+        }
+        if (vfov && (*vfov <= 0.0f || *vfov >= 180.0f)) {
+            throw std::runtime_error("the field of view must be between 0 and 180 degrees");
+        }
+        edit = [location, target, vfov](PreviewState& state) {
+            state.camera.location = location;
+            state.camera.target = target;
+            if (vfov) {
+                state.camera.vfov = *vfov * Utils::PI / 180.0f;
+            }
+            return true;
+        };
+    } else if (name == "lens") {
+        const auto aperture = readValue<float>(in, "an aperture");
+        const float focusDistance =
+            readOptionalValue<float>(in, "a focus distance").value_or(0.0f);
+        if (aperture < 0.0f || focusDistance < 0.0f) {
+            throw std::runtime_error("the aperture and focus distance must be positive");
+        }
+        edit = [aperture, focusDistance](PreviewState& state) {
+            state.camera.aperture = aperture;
+            state.camera.focusDistance = focusDistance;
+            return true;
+        };
+    } else if (name == "material") {
+        const auto index = readValue<int>(in, "an object index");
+        if (index < 0 || index >= nObjects) {
+            throw std::runtime_error("there are " + std::to_string(nObjects) + " objects");
+        }
+        const Material material = readMaterial(in);
+        edit = [index, material](PreviewState& state) {
+            const auto nonLights = static_cast<int>(state.objects.size());
+            auto& object =
+                index < nonLights ? state.objects[index] : state.lights[index - nonLights];
+            object->material = material;
+            return true;
+        };
+    } else if (name == "spp") {
+        const auto nSamples = readValue<int>(in, "a number of samples");
+        if (nSamples <= 0) {
+            throw std::runtime_error("the number of samples must be positive");
+        }
+        // The samples already accumulated are kept
+        edit = [nSamples](PreviewState& state) {
+            state.params.nSamples = nSamples;
+            return false;
+        };
+    } else if (name == "bounces") {
+        const auto maxBounces = readValue<int>(in, "a number of bounces");
+        if (maxBounces < 0) {
+            throw std::runtime_error("the number of bounces must be positive");
+        }
+        edit = [maxBounces](PreviewState& state) {
+            state.params.maxBounces = maxBounces;
+            return true;
+        };
+    } else if (name == "size") {
+        const auto width = readValue<int>(in, "a width");
+        const auto height = readValue<int>(in, "a height");
+        if (width <= 0 || height <= 0) {
+            throw std::runtime_error("the size must be positive");
+        }
+        edit = [width, height](PreviewState& state) {
+            state.params.width = width;
+            state.params.height = height;
+            return true;
+        };
+    } else if (name == "exposure") {
+        const auto exposure = readValue<float>(in, "an exposure");
+        edit = [exposure](PreviewState& state) {
+            state.toneMapping.exposure = exposure;
+            return false;
+        };
+    } else {
+        throw std::runtime_error("unknown command");
+    }
+
+    std::string extra;
+    if (in >> extra) {
+        throw std::runtime_error("unexpected " + extra);
+    }
+    return edit;
+}
+
+/* Calls handleLine on each line read from fd, until the end of the file or until it returns
+   false. */
+template <typename LineHandler> void forEachLine(int fd, LineHandler handleLine) {
+    std::string buffer;
+    char chunk[4096];
+    while (true) {
+        const ssize_t received = read(fd, chunk, sizeof(chunk));
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            if (!buffer.empty()) {
+                handleLine(buffer);
+            }
+            return;
+        }
+        buffer.append(chunk, static_cast<std::size_t>(received));
+        for (std::size_t newline = buffer.find('\n'); newline != std::string::npos;
+             newline = buffer.find('\n')) {
+            const std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if (!handleLine(line)) {
+                return;
+            }
+        }
+    }
+}
+
+int listenOnUnixSocket(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Unix socket path too long: " + path);
+    }
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str()); // Left over by a previous preview
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(fd, 4) != 0) {
+        throw std::runtime_error("Could not listen on " + path + ": " + std::strerror(errno));
+    }
+    return fd;
+}
+
+/* Reads the commands until quit, or the end of stdin. Clients of the socket are served one at a
+   time. */
+void readCommands(const std::string& socketPath, int nObjects, CommandQueue& queue) {
+    bool quit = false;
+    // Errors are sent back to the client, or written to stderr for stdin (replyFd < 0)
+    auto handleLine = [&](const std::string& line, int replyFd) {
+        std::istringstream in(line);
+        std::string name;
+        if (!(in >> name)) {
+            return true;
+        }
+        if (name == "quit") {
+            quit = true;
+            return false;
+        }
+        try {
+            queue.push(parseCommand(name, in, nObjects));
+        } catch (const std::runtime_error& e) {
+            const std::string message = "error: " + line + ": " + e.what() + '\n';
+            if (replyFd >= 0) {
+                send(replyFd, message.data(), message.size(), MSG_NOSIGNAL);
+            } else {
+                std::cerr << message;
+            }
+        }
+        return true;
+    };
+
+    try {
+        if (socketPath.empty()) {
+            forEachLine(STDIN_FILENO,
+                        [&](const std::string& line) { return handleLine(line, -1); });
+        } else {
+            const int server = listenOnUnixSocket(socketPath);
+            std::cout << "Waiting for commands on " << socketPath << std::endl;
+            while (!quit) {
+                const int client = accept(server, nullptr, nullptr);
+                if (client < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error(std::string("Could not accept a client: ") +
+                                             std::strerror(errno));
+                }
+                forEachLine(client,
+                            [&](const std::string& line) { return handleLine(line, client); });
+                close(client);
+            }
+            close(server);
+            unlink(socketPath.c_str());
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << '\n';
+    }
+    queue.close();
+}
+
+/* Adds samples to the tiles until they have targetSamples, unless cancel gets set in the
+   meantime. Returns whether the pass was completed. */
+bool renderPass(const PerspectiveCamera& camera, const Scene& scene, const RenderParams& params,
+                const std::vector<Tile>& tiles, int targetSamples, Accumulator& accumulator,
+                const std::atomic<bool>& cancel) {
+    const TileRenderer renderTile = selectTileRenderer(params);
+    const int nTiles = static_cast<int>(tiles.size());
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int i = 0; i < nTiles; ++i) {
+        if (cancel.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        RenderStats stats;
+        renderTile(camera, scene, params, tiles[i], targetSamples, accumulator, stats);
+    }
+    return !cancel;
+}
+
+void writeFrame(const Accumulator& accumulator, const ToneMapParams& toneMapping,
+                const std::string& outputFile) {
+    // Written to a hidden file and then renamed, so that viewers never load a partial frame
+    const std::filesystem::path output(outputFile);
+    const std::filesystem::path partial =
+        output.parent_path() / ("." + output.filename().string());
+    PNGEncodeSettings pngSettings;
+    pngSettings.compression = PNGCompression::Store;
+    saveRender(tonemap(accumulator.resolve().color, toneMapping), partial.string(), pngSettings);
+    std::filesystem::rename(partial, output);
+}
+} // namespace
+
+void runPreview(const std::vector<std::shared_ptr<Intersectable>>& objects,
+                const std::vector<std::shared_ptr<Intersectable>>& lights, const Color& skyColor,
+                const CameraSettings& camera, const RenderParams& params,
+                const ToneMapParams& toneMapping, const std::string& outputFile,
+                const std::string& socketPath) {
+    PreviewState state{objects, lights, skyColor, camera, params, toneMapping};
+#if defined(_OPENMP)
+    omp_set_num_threads(makeThreadLayout(params.threadPolicy.withEnvironmentOverrides()).nThreads);
+#endif
+
+    CommandQueue queue;
+    std::thread reader(readCommands, socketPath, static_cast<int>(objects.size() + lights.size()),
+                       std::ref(queue));
+
+    std::optional<Scene> scene;
+    std::optional<PerspectiveCamera> perspectiveCamera;
+    std::optional<Accumulator> accumulator;
+    std::vector<Tile> tiles;
+    int samples = 0;
+    bool restart = true;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Edit> edits;
+    // Waits for commands once the render is complete
+    while (queue.take(edits, !restart && samples >= state.params.nSamples)) {
+        for (const Edit& edit : edits) {
+            restart = edit(state) || restart;
+        }
+
+        if (restart) {
+            const RenderParams& p = state.params;
+            scene.emplace(state.objects, state.lights, p, state.skyColor);
+            perspectiveCamera = state.camera.makeCamera();
+            accumulator.emplace(p.width, p.height, p.seed);
+            tiles = makeTiles(p.width, p.height, p.tileSize);
+            samples = 0;
+            restart = false;
+            start = std::chrono::steady_clock::now();
+        }
+
+        if (samples < state.params.nSamples) {
+            // The first passes are short, to give feedback as soon as possible
+            const int targetSamples =
+                samples == 0 ? 1
+                             : std::min({2 * samples, samples + state.params.samplesPerPass,
+                                         state.params.nSamples});
+            if (renderPass(*perspectiveCamera, *scene, state.params, tiles, targetSamples,
+                           *accumulator, queue.pending)) {
+                samples = targetSamples;
+                writeFrame(*accumulator, state.toneMapping, outputFile);
+                const std::chrono::duration<float> elapsed =
+                    std::chrono::steady_clock::now() - start;
+                std::cout << '\r' << samples << '/' << state.params.nSamples << " spp in "
+                          << elapsed.count() << " s" << std::string(10, ' ') << std::flush;
+            }
+        } else if (!edits.empty()) {
+            writeFrame(*accumulator, state.toneMapping, outputFile);
+        }
+    }
+    std::cout << std::endl;
+    reader.join();
+}
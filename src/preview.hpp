@@ -0,0 +1,36 @@
+#ifndef PREVIEW_HPP
+#define PREVIEW_HPP
+
+#include "camera.hpp"
+#include "color.hpp"
+#include "intersectable.hpp"
+#include "params.hpp"
+#include "tonemap.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Interactive preview : the scene is kept in memory and rendered progressively, the latest frame
+   being written to outputFile after each pass. Commands are read line by line from stdin, or
+   from the clients of a Unix socket if socketPath is not empty, e.g. with
+   echo "spp 64" | socat - UNIX-CONNECT:/tmp/preview.sock
+
+     camera x y z targetX targetY targetZ [vfov]   vfov in degrees
+     lens aperture [focusDistance]
+     material i diffuse|metal|emissive|refractive r g b [smoothness|emission|IOR]
+     spp n
+     bounces n
+     size width height
+     exposure stops
+     quit
+
+   Objects are indexed in order, followed by the lights. Any command cancels the pass being
+   rendered, and all but exposure restart the accumulation from scratch. Errors are reported on
+   stderr, or to the client. The material commands modify the objects. */
+void runPreview(const std::vector<std::shared_ptr<Intersectable>>& objects,
+                const std::vector<std::shared_ptr<Intersectable>>& lights, const Color& skyColor,
+                const CameraSettings& camera, const RenderParams& params,
+                const ToneMapParams& toneMapping, const std::string& outputFile,
+                const std::string& socketPath = "");
+
+#endif
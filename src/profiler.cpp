@@ -0,0 +1,75 @@
+#include "profiler.hpp"
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Profiler {
+namespace {
+struct TraceEvent {
+    const char* name;
+    int64_t arg;
+    Clock::time_point start;
+    Clock::time_point end;
+};
+
+/* Buffers are owned by the profiler rather than by their thread, so that the events of
+   finished threads are kept until the trace is saved. */
+struct ThreadBuffer {
+    int threadId;
+    std::vector<TraceEvent> events;
+};
+
+std::mutex buffersMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+const Clock::time_point origin = Clock::now();
+
+ThreadBuffer& threadBuffer() {
+    thread_local ThreadBuffer* buffer = [] {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(
+            std::make_unique<ThreadBuffer>(ThreadBuffer{static_cast<int>(buffers.size()), {}}));
+        return buffers.back().get();
+    }();
+    return *buffer;
+}
+
+#if defined(RAYTRACER_PROFILING)
+double microseconds(Clock::time_point t) {
+    return std::chrono::duration<double, std::micro>(t - origin).count();
+}
+#endif
+} // namespace
+
+void record(const char* name, int64_t arg, Clock::time_point start, Clock::time_point end) {
+    threadBuffer().events.push_back({name, arg, start, end});
+}
+
+bool saveChromeTrace(const std::string& filename) {
+#if defined(RAYTRACER_PROFILING)
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    std::ofstream file(filename);
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    bool first = true;
+    for (const auto& buffer : buffers) {
+        for (const TraceEvent& event : buffer->events) {
+            file << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name
+                 << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadId
+                 << ",\"ts\":" << microseconds(event.start)
+                 << ",\"dur\":" << microseconds(event.end) - microseconds(event.start);
+            if (event.arg >= 0) {
+                file << ",\"args\":{\"id\":" << event.arg << '}';
+            }
+            file << '}';
+            first = false;
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return true;
+#else
+    (void)filename;
+    return false;
+#endif
+}
+} // namespace Profiler
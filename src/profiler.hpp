@@ -0,0 +1,46 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/* Scoped timers, recorded per thread and exported in the Chrome trace event format (open the file
+   in chrome://tracing or https://ui.perfetto.dev). Timers are only compiled in when
+   RAYTRACER_PROFILING is defined (cmake -DPROFILING=ON), so that they cost nothing otherwise. */
+
+namespace Profiler {
+using Clock = std::chrono::steady_clock;
+
+/* Records an event for the calling thread. name must outlive the profiler (e.g. a literal). */
+void record(const char* name, int64_t arg, Clock::time_point start, Clock::time_point end);
+
+/* Writes all the events recorded so far. Returns false if profiling is compiled out. */
+bool saveChromeTrace(const std::string& filename);
+
+class Scope {
+    const char* name;
+    int64_t arg;
+    Clock::time_point start;
+
+  public:
+    explicit Scope(const char* name, int64_t arg = -1)
+        : name(name), arg(arg), start(Clock::now()) {}
+    ~Scope() { record(name, arg, start, Clock::now()); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+} // namespace Profiler
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#if defined(RAYTRACER_PROFILING)
+// PROFILE_SCOPE("name") or PROFILE_SCOPE("name", integer shown as the event's argument)
+#define PROFILE_SCOPE(...) const Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(__VA_ARGS__)
+#else
+#define PROFILE_SCOPE(...)
+#endif
+
+#endif
@@ -8,8 +8,12 @@ struct Ray {
     constexpr static float MAX_RAY_DIST{1.0e4f};
 
     Point3 origin;
+    // Must be normalized
     Vector3 direction;
     float maxDist = MAX_RAY_DIST;
+    // When the ray is traced, within the shutter interval of the camera. Moving objects are at
+    // their start position at time 0, and at their end position at time 1.
+    float time = 0.0f;
     bool isDiffuse;
 
     Ray(const Point3& origin, const Vector3& direction, bool isDiffuse = false)
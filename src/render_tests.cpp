@@ -0,0 +1,97 @@
+/* Regression tests of the renderer, on small renders of scenes that once broke it. Each test
+   returns whether it passed, and the program fails if any of them didn't.
+   Usage : ./render_tests */
+
+#include "camera.hpp"
+#include "color.hpp"
+#include "environment.hpp"
+#include "framebuffer.hpp"
+#include "intersectable.hpp"
+#include "material.hpp"
+#include "params.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr int WIDTH = 32;
+constexpr int HEIGHT = 18;
+
+/* Average of the components of the pixels, or NaN if any of them isn't finite. */
+double meanRadiance(const Framebuffer& image) {
+    double sum = 0.0;
+    for (const Color& pixel : image.pixels) {
+        for (float component : {pixel.r, pixel.g, pixel.b}) {
+            if (!std::isfinite(component)) {
+                return std::nan("");
+            }
+            sum += component;
+        }
+    }
+    return sum / static_cast<double>(3 * image.pixels.size());
+}
+
+double renderMean(const std::vector<std::shared_ptr<Intersectable>>& nonLights,
+                  const std::vector<std::shared_ptr<Intersectable>>& lights,
+                  bool nextEventEstimation, int spp,
+                  const std::shared_ptr<const EnvironmentMap>& environment = nullptr) {
+    RenderParams params{WIDTH, HEIGHT, 4, spp, nextEventEstimation, false};
+    Scene scene(nonLights, lights, params);
+    scene.environment = environment;
+    const PerspectiveCamera camera(Point3(0.0f, 1.0f, 0.0f), Point3(0.0f, 1.0f, -5.0f), 1.0f);
+    return meanRadiance(rayTrace(camera, scene, params).color);
+}
+
+/* Whether the means of the renders with and without next event estimation agree. */
+bool check(const std::string& name, double withNEE, double withoutNEE, double tolerance) {
+    const bool passed = std::isfinite(withNEE) && std::isfinite(withoutNEE) &&
+                        std::fabs(withNEE - withoutNEE) <= tolerance * withoutNEE;
+    std::cout << (passed ? "passed" : "FAILED") << " : " << name << " (mean " << withNEE
+              << " with next event estimation, " << withoutNEE << " without)\n";
+    return passed;
+}
+
+/* Next event estimation used to index the cells of an empty light sampler. */
+bool sceneWithoutLights() {
+    const std::vector<std::shared_ptr<Intersectable>> shapes{
+        std::make_shared<Plane>(Point3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f),
+                                Material::Diffuse(Color(0.8f))),
+        std::make_shared<Sphere>(Point3(0.0f, 1.0f, -5.0f), 1.0f,
+                                 Material::Diffuse(Color(0.3f, 0.5f, 0.9f))),
+    };
+    return check("scene without lights", renderMean(shapes, {}, true, 64),
+                 renderMean(shapes, {}, false, 64), 0.02);
+}
+
+/* An environment map lighting a scene without lights used to crash in the same way, and its
+   samples must add up to the same lighting as the diffuse rays which escape to it. */
+bool environmentOnly() {
+    // A dim sky, with a bright patch above the horizon
+    Framebuffer sky(16, 8, Color(0.2f, 0.3f, 0.5f));
+    for (int y = 1; y < 3; ++y) {
+        for (int x = 6; x < 9; ++x) {
+            sky(x, y) = Color(8.0f, 7.0f, 5.0f);
+        }
+    }
+    const auto environment = std::make_shared<const EnvironmentMap>(sky);
+    const std::vector<std::shared_ptr<Intersectable>> shapes{
+        std::make_shared<Plane>(Point3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f),
+                                Material::Diffuse(Color(0.8f))),
+        std::make_shared<Sphere>(Point3(0.0f, 1.0f, -5.0f), 1.0f,
+                                 Material::Diffuse(Color(0.3f, 0.5f, 0.9f))),
+    };
+    return check("environment only", renderMean(shapes, {}, true, 256, environment),
+                 renderMean(shapes, {}, false, 256, environment), 0.02);
+}
+} // namespace
+
+int main() {
+    bool passed = true;
+    passed = sceneWithoutLights() && passed;
+    passed = environmentOnly() && passed;
+    return passed ? 0 : 1;
+}
@@ -1,9 +1,12 @@
 #ifndef SAMPLING_HPP
 #define SAMPLING_HPP
 
+#include "fastmath.hpp"
 #include "utils.hpp"
 #include "vector3.hpp"
+#include <algorithm>
 #include <cmath>
+#include <utility>
 
 struct DirectionSamplingResult {
     Vector3 direction;
@@ -21,29 +24,62 @@ struct PointSamplingResult {
         : point(point), normal(normal), pdf(pdf) {}
 };
 
-/* Returns the given normalized vector rotated by polar angle theta and azimuth phi in its local
-spherical coordinate system. The reference for the azimuth is chosen at random, as all my
-sampling needs are isotropical for now. */
-inline Vector3 sphericalCoordsRotation(const Vector3& zenithDirection, float theta, float phi) {
-    // One of the many ways to get an orthogonal basis from the zenith direction.
-    float x = zenithDirection.x, y = zenithDirection.y, z = zenithDirection.z;
-    auto u = (x != 0.0f || y != 0.0f) ? Vector3(-y, x, 0.0f).normalized()
-                                      : Vector3(-z, 0.0f, x).normalized();
-    auto v = zenithDirection.cross(u);
-
-    float sinTheta = std::sin(theta);
-    return std::cos(theta) * zenithDirection + sinTheta * std::cos(phi) * u +
-           sinTheta * std::sin(phi) * v;
+/* Orthonormal basis (u, v, w) whose w axis is the given normalized vector. */
+struct OrthonormalBasis {
+    Vector3 u;
+    Vector3 v;
+    Vector3 w;
+
+    /* Branchless construction from "Building an Orthonormal Basis, Revisited" (Duff et al.,
+       2017), without any normalization. */
+    explicit OrthonormalBasis(const Vector3& w)
+        : u(0.0f, 0.0f, 0.0f), v(0.0f, 0.0f, 0.0f), w(w) {
+        const float sign = std::copysign(1.0f, w.z);
+        const float a = -1.0f / (sign + w.z);
+        const float b = w.x * w.y * a;
+        u = Vector3(1.0f + sign * Utils::sqr(w.x) * a, sign * b, -sign * w.x);
+        v = Vector3(b, sign + Utils::sqr(w.y) * a, -w.y);
+    }
+
+    /* Converts coordinates in this basis to world coordinates. */
+    Vector3 toWorld(float x, float y, float z) const { return x * u + y * v + z * w; }
+};
+
+/* Returns the given normalized vector rotated by the polar angle of cosine cosTheta and by
+   azimuth phi in its local spherical coordinate system. The reference for the azimuth is
+   arbitrary, as all my sampling needs are isotropical for now. */
+inline Vector3 cosThetaRotation(const Vector3& zenithDirection, float cosTheta, float phi) {
+    float sinTheta = std::sqrt(std::max(0.0f, 1.0f - Utils::sqr(cosTheta)));
+    return OrthonormalBasis(zenithDirection)
+        .toWorld(sinTheta * FastMath::cos(phi), sinTheta * FastMath::sin(phi), cosTheta);
+}
+
+/* Maps a uniform sample of the unit square to a uniform sample of the unit disk, preserving
+   areas and adjacency ("A Low Distortion Map Between Disk and Square", Shirley & Chiu 1997). */
+inline std::pair<float, float> sampleDiskConcentric(float u1, float u2) {
+    const float a = 2.0f * u1 - 1.0f;
+    const float b = 2.0f * u2 - 1.0f;
+    if (a == 0.0f && b == 0.0f) {
+        return {0.0f, 0.0f};
+    }
+    float r, phi;
+    if (std::abs(a) > std::abs(b)) {
+        r = a;
+        phi = (Utils::PI / 4.0f) * (b / a);
+    } else {
+        r = b;
+        phi = Utils::PI / 2.0f - (Utils::PI / 4.0f) * (a / b);
+    }
+    return {r * FastMath::cos(phi), r * FastMath::sin(phi)};
 }
 
 /* EDIT: This is actually a bizarre method and does not produce a cosine-weighted sampling,
    like I initially thought it did. */
 inline Vector3 sampleHemisphereGlossy(const Vector3& zenithDirection, float exponent) {
-    float theta = std::acos(std::pow(Utils::random(), exponent));
+    float cosTheta = FastMath::pow(Utils::random(), exponent);
     float phi = Utils::TWO_PI * Utils::random();
 
-    Vector3 dir = sphericalCoordsRotation(zenithDirection, theta, phi);
-    return dir;
+    return cosThetaRotation(zenithDirection, cosTheta, phi);
 }
 
 /* The proper way of doing cosine-weighted hemisphere sampling.
@@ -52,15 +88,44 @@ inline Vector3 sampleHemisphereGlossy(const Vector3& zenithDirection, float expo
    Default value is 1 (i.e. an angle of PI/2), which corresponds to the whole hemisphere. */
 inline DirectionSamplingResult sampleHemisphereCosineWeighted(const Vector3& zenithDirection,
                                                               float cosThetaMax = 0.0f) {
+    // Projecting uniform points of a disk of radius sinThetaMax onto the hemisphere (Malley's
+    // method) gives a cosine-weighted distribution.
     float sinThetaMaxSquared = 1 - Utils::sqr(cosThetaMax);
-    float theta = std::asin(std::sqrt(Utils::random() * sinThetaMaxSquared));
-    float phi = Utils::TWO_PI * Utils::random();
-    float pdf = std::cos(theta) / (Utils::PI * sinThetaMaxSquared);
+    float sinThetaMax = std::sqrt(sinThetaMaxSquared);
+    float u1 = Utils::random();
+    float u2 = Utils::random();
+    auto [x, y] = sampleDiskConcentric(u1, u2);
+    x *= sinThetaMax;
+    y *= sinThetaMax;
+    // Samples on the rim of the disk would have a null pdf
+    float cosTheta = std::sqrt(std::max(1.0e-12f, 1.0f - x * x - y * y));
+    float pdf = cosTheta / (Utils::PI * sinThetaMaxSquared);
 
-    Vector3 dir = sphericalCoordsRotation(zenithDirection, theta, phi);
+    Vector3 dir = OrthonormalBasis(zenithDirection).toWorld(x, y, cosTheta);
     return DirectionSamplingResult(dir, pdf);
 }
 
+/* Uniform sampling of the directions within cosThetaMax of the normalized direction w.
+   A uniform point of the unit disk at squared radius r2 maps to cos(theta) = 1 - r2 * k, with
+   k = 1 - cosThetaMax, which is uniform as the cap requires, and keeps its azimuth : its
+   coordinates are scaled by sin(theta) / sqrt(r2) = sqrt(k * (2 - r2 * k)), without any
+   trigonometric function. */
+inline DirectionSamplingResult sampleConeUniform(const Vector3& w, float cosThetaMax) {
+    float x, y, r2;
+    do {
+        x = 2.0f * Utils::random() - 1.0f;
+        y = 2.0f * Utils::random() - 1.0f;
+        r2 = x * x + y * y;
+    } while (r2 > 1.0f);
+
+    const float k = 1.0f - cosThetaMax;
+    const float cosTheta = 1.0f - r2 * k;
+    const float scale = std::sqrt(std::max(0.0f, k * (2.0f - r2 * k)));
+    const float pdf = 1.0f / (Utils::TWO_PI * k);
+    return DirectionSamplingResult(OrthonormalBasis(w).toWorld(scale * x, scale * y, cosTheta),
+                                   pdf);
+}
+
 inline Point3 sampleSpherePoint(const Point3& center, float radius) {
     // Using a rejection technique as it is likely more efficient in 3D than sampling spherical
     // coordinates, which requires extensive trigonometric and cube-root operations.
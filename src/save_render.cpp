@@ -0,0 +1,488 @@
+#include "save_render.hpp"
+#include "color.hpp"
+#include "profiler.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <lodepng.h>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+template <typename T> void appendLittleEndian(std::vector<unsigned char>& bytes, T value) {
+    unsigned char raw[sizeof(T)];
+    std::memcpy(raw, &value, sizeof(T));
+    // Assumes a little-endian host, like every target we currently build on
+    bytes.insert(bytes.end(), raw, raw + sizeof(T));
+}
+
+void appendString(std::vector<unsigned char>& bytes, const std::string& str) {
+    bytes.insert(bytes.end(), str.begin(), str.end());
+    bytes.push_back('\0');
+}
+
+void appendAttribute(std::vector<unsigned char>& header, const std::string& name,
+                     const std::string& type, const std::vector<unsigned char>& value) {
+    appendString(header, name);
+    appendString(header, type);
+    appendLittleEndian(header, static_cast<int32_t>(value.size()));
+    header.insert(header.end(), value.begin(), value.end());
+}
+
+/* Converts to IEEE 754 half precision, rounding to nearest even. Overflows become
+   infinity and NaNs stay NaNs. */
+uint16_t toHalf(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    const uint32_t absBits = bits & 0x7fffffffu;
+
+    if (absBits >= 0x7f800000u) { // Inf or NaN
+        return sign | 0x7c00u | (absBits > 0x7f800000u ? 0x200u : 0u);
+    }
+    if (absBits >= 0x477ff000u) { // Rounds to a value that overflows the half range
+        return sign | 0x7c00u;
+    }
+    if (absBits < 0x38800000u) { // Subnormal half (or zero)
+        if (absBits < 0x33000000u) {
+            return sign;
+        }
+        const uint32_t exponent = absBits >> 23;
+        const uint32_t mantissa = (absBits & 0x007fffffu) | 0x00800000u;
+        const uint32_t shift = 126u - exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1u);
+        const uint32_t halfway = 1u << (shift - 1u);
+        if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+            ++half;
+        }
+        return sign | static_cast<uint16_t>(half);
+    }
+    uint32_t half = ((absBits - 0x38000000u) >> 13);
+    const uint32_t remainder = absBits & 0x1fffu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+        ++half;
+    }
+    return sign | static_cast<uint16_t>(half);
+}
+} // namespace
+
+unsigned char to8Bit(float f) { return static_cast<unsigned char>(std::round(f * 255)); }
+
+std::vector<unsigned char> to8BitRGB(const Framebuffer& render) {
+    PROFILE_SCOPE("to8BitRGB");
+    const long nPixels = static_cast<long>(render.pixels.size());
+    std::vector<unsigned char> img(3 * nPixels);
+    if (nPixels == 0) {
+        return img;
+    }
+    const Color* pixels = render.pixels.data();
+    unsigned char* bytes = img.data();
+
+    // Same rounding as to8Bit, without the call to std::round which prevents vectorization.
+    auto toByte = [](float f) {
+        return static_cast<unsigned char>(std::min(std::max(f, 0.0f), 1.0f) * 255.0f + 0.5f);
+    };
+#if defined(_OPENMP)
+#pragma omp parallel for simd
+#endif
+    for (long i = 0; i < nPixels; ++i) {
+        bytes[3 * i] = toByte(pixels[i].r);
+        bytes[3 * i + 1] = toByte(pixels[i].g);
+        bytes[3 * i + 2] = toByte(pixels[i].b);
+    }
+    return img;
+}
+
+void saveRenderToPNG(const Framebuffer& render, const std::string& filename,
+                     const PNGEncodeSettings& settings) {
+    PROFILE_SCOPE("saveRenderToPNG");
+    lodepng::State state;
+    state.info_raw.colortype = LCT_RGB;
+    state.info_raw.bitdepth = 8;
+    state.info_png.color.colortype = LCT_RGB;
+    state.info_png.color.bitdepth = 8;
+    // Scanning the image for a smaller color type is costly and never pays off on renders
+    state.encoder.auto_convert = 0;
+
+    LodePNGCompressSettings& zlib = state.encoder.zlibsettings;
+    switch (settings.compression) {
+    case PNGCompression::Store:
+        zlib.btype = 0;
+        zlib.use_lz77 = 0;
+        break;
+    case PNGCompression::Fast:
+        zlib.windowsize = 256;
+        zlib.nicematch = 16;
+        zlib.lazymatching = 0;
+        break;
+    case PNGCompression::Best:
+        zlib.windowsize = 32768;
+        zlib.nicematch = 258;
+        break;
+    case PNGCompression::Default:
+        break;
+    }
+
+    switch (settings.filter) {
+    case PNGFilter::NoFilter:
+        state.encoder.filter_strategy = LFS_ZERO;
+        break;
+    case PNGFilter::Entropy:
+        state.encoder.filter_strategy = LFS_ENTROPY;
+        break;
+    case PNGFilter::MinSum:
+        state.encoder.filter_strategy = LFS_MINSUM;
+        break;
+    }
+
+    std::vector<unsigned char> png;
+    const std::vector<unsigned char> img = to8BitRGB(render);
+    unsigned error;
+    {
+        PROFILE_SCOPE("lodepng::encode");
+        error = lodepng::encode(png, img, render.width, render.height, state);
+    }
+    if (error) {
+        throw std::runtime_error("PNG encoding failed: " + std::string(lodepng_error_text(error)));
+    }
+    lodepng::save_file(png, filename);
+}
+
+void saveRenderToPPM(const Framebuffer& render, const std::string& filename) {
+    PROFILE_SCOPE("saveRenderToPPM");
+    std::vector<unsigned char> img = to8BitRGB(render);
+    std::ofstream file(filename, std::ios::binary);
+    file << "P6\n" << render.width << ' ' << render.height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(img.data()), static_cast<std::streamsize>(img.size()));
+}
+
+void saveRenderToBMP(const Framebuffer& render, const std::string& filename) {
+    PROFILE_SCOPE("saveRenderToBMP");
+    std::vector<unsigned char> img = to8BitRGB(render);
+    // Rows are stored bottom to top, in BGR order and padded to a multiple of 4 bytes
+    const int rowSize = (3 * render.width + 3) & ~3;
+    const auto pixelDataSize = static_cast<uint32_t>(rowSize * render.height);
+    constexpr uint32_t headersSize = 14 + 40;
+
+    std::vector<unsigned char> header{'B', 'M'};
+    appendLittleEndian(header, headersSize + pixelDataSize);
+    appendLittleEndian(header, uint32_t{0}); // Reserved
+    appendLittleEndian(header, headersSize);
+    appendLittleEndian(header, uint32_t{40}); // BITMAPINFOHEADER
+    appendLittleEndian(header, static_cast<int32_t>(render.width));
+    appendLittleEndian(header, static_cast<int32_t>(render.height));
+    appendLittleEndian(header, uint16_t{1});  // Planes
+    appendLittleEndian(header, uint16_t{24}); // Bits per pixel
+    appendLittleEndian(header, uint32_t{0});  // BI_RGB, no compression
+    appendLittleEndian(header, pixelDataSize);
+    appendLittleEndian(header, int32_t{2835}); // 72 DPI
+    appendLittleEndian(header, int32_t{2835});
+    appendLittleEndian(header, uint32_t{0}); // Palette size
+    appendLittleEndian(header, uint32_t{0}); // Important colors
+
+    std::vector<unsigned char> pixelData(pixelDataSize, 0);
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+    for (int y = 0; y < render.height; ++y) {
+        const unsigned char* src = &img[3 * static_cast<std::size_t>(y) * render.width];
+        unsigned char* dst = &pixelData[static_cast<std::size_t>(render.height - 1 - y) * rowSize];
+        for (int x = 0; x < render.width; ++x) {
+            dst[3 * x] = src[3 * x + 2];
+            dst[3 * x + 1] = src[3 * x + 1];
+            dst[3 * x + 2] = src[3 * x];
+        }
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(header.data()),
+               static_cast<std::streamsize>(header.size()));
+    file.write(reinterpret_cast<const char*>(pixelData.data()),
+               static_cast<std::streamsize>(pixelData.size()));
+}
+
+void saveRender(const Framebuffer& render, const std::string& filename,
+                const PNGEncodeSettings& settings) {
+    const std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    if (extension == "ppm") {
+        saveRenderToPPM(render, filename);
+    } else if (extension == "bmp") {
+        saveRenderToBMP(render, filename);
+    } else if (extension == "png") {
+        saveRenderToPNG(render, filename, settings);
+    } else {
+        throw std::runtime_error("Unsupported output format: " + filename);
+    }
+}
+
+void saveNormalsToPNG(const NormalBuffer& normals, const std::string& filename) {
+    Framebuffer img(normals.width, normals.height);
+    for (std::size_t i = 0; i < normals.pixels.size(); ++i) {
+        const Vector3& n = normals.pixels[i];
+        img.pixels[i] = Color(0.5f * n.x + 0.5f, 0.5f * n.y + 0.5f, 0.5f * n.z + 0.5f);
+    }
+    saveRenderToPNG(img, filename);
+}
+
+void saveDepthToPNG(const DepthBuffer& depth, const std::string& filename) {
+    float maxDepth = *std::max_element(depth.pixels.begin(), depth.pixels.end());
+    Framebuffer img(depth.width, depth.height);
+    for (std::size_t i = 0; i < depth.pixels.size(); ++i) {
+        img.pixels[i] = Color(maxDepth > 0.0f ? 1.0f - depth.pixels[i] / maxDepth : 0.0f);
+    }
+    saveRenderToPNG(img, filename);
+}
+
+void saveCostHeatmapToPNG(const CostBuffer& cost, const std::string& filename) {
+    std::vector<float> sorted = cost.pixels;
+    const auto percentile =
+        sorted.begin() + static_cast<std::ptrdiff_t>(0.99 * static_cast<double>(sorted.size() - 1));
+    std::nth_element(sorted.begin(), percentile, sorted.end());
+    const float maxCost = *percentile;
+
+    // Black, blue, magenta, orange, yellow, white
+    const Color stops[] = {Color(0.0f, 0.0f, 0.0f), Color(0.1f, 0.1f, 0.6f),
+                           Color(0.7f, 0.1f, 0.6f), Color(1.0f, 0.5f, 0.1f),
+                           Color(1.0f, 0.9f, 0.2f), Color(1.0f, 1.0f, 1.0f)};
+    constexpr int nSegments = sizeof(stops) / sizeof(stops[0]) - 1;
+
+    Framebuffer img(cost.width, cost.height);
+    for (std::size_t i = 0; i < cost.pixels.size(); ++i) {
+        const float t = maxCost > 0.0f ? Utils::clamp(cost.pixels[i] / maxCost) * nSegments : 0.0f;
+        const int segment = std::min(static_cast<int>(t), nSegments - 1);
+        const float f = t - static_cast<float>(segment);
+        img.pixels[i] = (1.0f - f) * stops[segment] + f * stops[segment + 1];
+    }
+    saveRenderToPNG(img, filename);
+}
+
+void saveRenderToPFM(const Framebuffer& render, const std::string& filename) {
+    PROFILE_SCOPE("saveRenderToPFM");
+    std::ofstream file(filename, std::ios::binary);
+    // A negative scale means little-endian data
+    file << "PF\n" << render.width << ' ' << render.height << "\n-1.0\n";
+
+    // PFM scanlines go from bottom to top
+    std::vector<float> line(3 * render.width);
+    for (int y = render.height - 1; y >= 0; --y) {
+        for (int x = 0; x < render.width; ++x) {
+            line[3 * x] = render(x, y).r;
+            line[3 * x + 1] = render(x, y).g;
+            line[3 * x + 2] = render(x, y).b;
+        }
+        file.write(reinterpret_cast<const char*>(line.data()),
+                   static_cast<std::streamsize>(line.size() * sizeof(float)));
+    }
+}
+
+void saveBufferToPFM(const Buffer2D<float>& buffer, const std::string& filename) {
+    std::ofstream file(filename, std::ios::binary);
+    file << "Pf\n" << buffer.width << ' ' << buffer.height << "\n-1.0\n";
+    for (int y = buffer.height - 1; y >= 0; --y) {
+        file.write(reinterpret_cast<const char*>(&buffer(0, y)),
+                   static_cast<std::streamsize>(buffer.width * sizeof(float)));
+    }
+}
+
+Framebuffer loadRenderFromPFM(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    std::string magic;
+    int width = 0;
+    int height = 0;
+    float scale = 0.0f;
+    file >> magic >> width >> height >> scale;
+    file.get(); // Single whitespace character before the pixel data
+
+    if (!file || magic != "PF" || width <= 0 || height <= 0) {
+        throw std::runtime_error("Could not read RGB PFM file " + filename);
+    }
+    if (scale > 0.0f) {
+        throw std::runtime_error("Big-endian PFM files are not supported: " + filename);
+    }
+
+    Framebuffer render(width, height);
+    std::vector<float> line(3 * width);
+    for (int y = height - 1; y >= 0; --y) {
+        file.read(reinterpret_cast<char*>(line.data()),
+                  static_cast<std::streamsize>(line.size() * sizeof(float)));
+        for (int x = 0; x < width; ++x) {
+            render(x, y) = Color(line[3 * x], line[3 * x + 1], line[3 * x + 2]);
+        }
+    }
+    if (!file) {
+        throw std::runtime_error("Truncated PFM file " + filename);
+    }
+    return render;
+}
+
+namespace {
+/* Reads a scanline of RGBE pixels, either flat or run-length encoded per component. */
+void readHDRScanline(std::ifstream& file, std::vector<unsigned char>& rgbe, int width) {
+    unsigned char start[4];
+    file.read(reinterpret_cast<char*>(start), 4);
+    const bool runLengthEncoded = width >= 8 && width < 32768 && start[0] == 2 && start[1] == 2 &&
+                                  ((start[2] << 8) | start[3]) == width;
+    if (!runLengthEncoded) {
+        std::copy(start, start + 4, rgbe.begin());
+        file.read(reinterpret_cast<char*>(rgbe.data() + 4),
+                  static_cast<std::streamsize>(rgbe.size() - 4));
+        return;
+    }
+    // Each component is stored separately, as runs of a repeated byte or of literal bytes
+    for (int component = 0; component < 4; ++component) {
+        int x = 0;
+        while (x < width && file) {
+            int count = file.get();
+            const bool run = count > 128;
+            count = run ? count - 128 : count;
+            if (count == 0 || x + count > width) {
+                throw std::runtime_error("Corrupted HDR scanline");
+            }
+            const int value = run ? file.get() : 0;
+            for (int i = 0; i < count; ++i, ++x) {
+                rgbe[4 * x + component] = static_cast<unsigned char>(run ? value : file.get());
+            }
+        }
+    }
+}
+} // namespace
+
+Framebuffer loadRenderFromHDR(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    std::string line;
+    std::getline(file, line);
+    if (!file || (line != "#?RADIANCE" && line != "#?RGBE")) {
+        throw std::runtime_error("Could not read Radiance HDR file " + filename);
+    }
+    // Header variables, up to an empty line
+    bool rgbe = true;
+    while (std::getline(file, line) && !line.empty()) {
+        if (line.rfind("FORMAT=", 0) == 0) {
+            rgbe = line == "FORMAT=32-bit_rle_rgbe";
+        }
+    }
+    std::string yAxis;
+    std::string xAxis;
+    int width = 0;
+    int height = 0;
+    file >> yAxis >> height >> xAxis >> width;
+    file.get(); // Newline before the pixel data
+    if (!file || !rgbe || yAxis != "-Y" || xAxis != "+X" || width <= 0 || height <= 0) {
+        throw std::runtime_error("Only top-to-bottom RGBE HDR files are supported: " + filename);
+    }
+
+    Framebuffer render(width, height);
+    std::vector<unsigned char> scanline(4 * static_cast<std::size_t>(width));
+    for (int y = 0; y < height; ++y) {
+        readHDRScanline(file, scanline, width);
+        for (int x = 0; x < width; ++x) {
+            const unsigned char* pixel = &scanline[4 * static_cast<std::size_t>(x)];
+            // The shared exponent is biased by 128, and mantissas are 8-bit fractions
+            const float scale = pixel[3] == 0 ? 0.0f : std::ldexp(1.0f, pixel[3] - 136);
+            render(x, y) = Color(pixel[0] * scale, pixel[1] * scale, pixel[2] * scale);
+        }
+    }
+    if (!file) {
+        throw std::runtime_error("Truncated HDR file " + filename);
+    }
+    return render;
+}
+
+Framebuffer loadRender(const std::string& filename) {
+    const std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    if (extension == "pfm") {
+        return loadRenderFromPFM(filename);
+    }
+    if (extension == "hdr") {
+        return loadRenderFromHDR(filename);
+    }
+    throw std::runtime_error("Unsupported HDR format: " + filename);
+}
+
+void saveRenderToEXR(const Framebuffer& render, const std::string& filename, bool halfFloat) {
+    PROFILE_SCOPE("saveRenderToEXR");
+    const int width = render.width;
+    const int height = render.height;
+    const int32_t pixelType = halfFloat ? 1 : 2;
+    const int bytesPerValue = halfFloat ? 2 : 4;
+
+    std::vector<unsigned char> header{0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0};
+
+    // Channels must be sorted alphabetically, and their data is stored in that order
+    std::vector<unsigned char> channels;
+    for (const char* name : {"B", "G", "R"}) {
+        appendString(channels, name);
+        appendLittleEndian(channels, pixelType);
+        appendLittleEndian(channels, int32_t{0}); // pLinear and reserved bytes
+        appendLittleEndian(channels, int32_t{1}); // x sampling
+        appendLittleEndian(channels, int32_t{1}); // y sampling
+    }
+    channels.push_back('\0');
+    appendAttribute(header, "channels", "chlist", channels);
+    appendAttribute(header, "compression", "compression", {0});
+
+    std::vector<unsigned char> window;
+    for (int32_t v : {0, 0, width - 1, height - 1}) {
+        appendLittleEndian(window, v);
+    }
+    appendAttribute(header, "dataWindow", "box2i", window);
+    appendAttribute(header, "displayWindow", "box2i", window);
+    appendAttribute(header, "lineOrder", "lineOrder", {0});
+
+    std::vector<unsigned char> value;
+    appendLittleEndian(value, 1.0f);
+    appendAttribute(header, "pixelAspectRatio", "float", value);
+    value.clear();
+    appendLittleEndian(value, 0.0f);
+    appendLittleEndian(value, 0.0f);
+    appendAttribute(header, "screenWindowCenter", "v2f", value);
+    value.clear();
+    appendLittleEndian(value, 1.0f);
+    appendAttribute(header, "screenWindowWidth", "float", value);
+    header.push_back('\0');
+
+    // Each scanline is converted in parallel, then the offset table is filled sequentially
+    std::vector<std::vector<unsigned char>> scanlines(height);
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+    for (int y = 0; y < height; ++y) {
+        std::vector<unsigned char>& line = scanlines[y];
+        line.reserve(8 + 3 * width * bytesPerValue);
+        appendLittleEndian(line, static_cast<int32_t>(y));
+        appendLittleEndian(line, static_cast<int32_t>(3 * width * bytesPerValue));
+        for (int channel = 2; channel >= 0; --channel) {
+            for (int x = 0; x < width; ++x) {
+                const Color& c = render(x, y);
+                const float f = channel == 0 ? c.r : (channel == 1 ? c.g : c.b);
+                if (halfFloat) {
+                    appendLittleEndian(line, toHalf(f));
+                } else {
+                    appendLittleEndian(line, f);
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned char> offsets;
+    auto offset = static_cast<uint64_t>(header.size() + sizeof(uint64_t) * height);
+    for (const auto& line : scanlines) {
+        appendLittleEndian(offsets, offset);
+        offset += line.size();
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(header.data()),
+               static_cast<std::streamsize>(header.size()));
+    file.write(reinterpret_cast<const char*>(offsets.data()),
+               static_cast<std::streamsize>(offsets.size()));
+    for (const auto& line : scanlines) {
+        file.write(reinterpret_cast<const char*>(line.data()),
+                   static_cast<std::streamsize>(line.size()));
+    }
+}
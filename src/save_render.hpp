@@ -1,29 +1,59 @@
 #ifndef IMAGE_HPP
 #define IMAGE_HPP
 
-#include "material.hpp"
-#include <fstream>
-#include <lodepng.h>
+#include "framebuffer.hpp"
 #include <string>
+
 #include <vector>
 
-unsigned char to8Bit(float f) { return static_cast<unsigned char>(std::round(f * 255)); }
+/* Trades file size for encoding speed. Store writes uncompressed deflate blocks, which is by far
+   the fastest, and Fast uses a small LZ77 window without lazy matching. */
+enum PNGCompression { Store, Fast, Default, Best };
+enum PNGFilter { NoFilter, MinSum, Entropy };
+
+struct PNGEncodeSettings {
+    PNGCompression compression = PNGCompression::Default;
+    PNGFilter filter = PNGFilter::MinSum;
+};
+
+unsigned char to8Bit(float f);
+
+/* Converts a display-ready framebuffer to interleaved 8-bit RGB, in parallel. */
+std::vector<unsigned char> to8BitRGB(const Framebuffer& render);
+
+/* All these expect a display-ready framebuffer, with values in [0, 1] (see tonemap.hpp). */
+void saveRenderToPNG(const Framebuffer& render, const std::string& filename,
+                     const PNGEncodeSettings& settings = PNGEncodeSettings());
+/* Uncompressed formats, for the fastest turnaround on previews. */
+void saveRenderToPPM(const Framebuffer& render, const std::string& filename);
+void saveRenderToBMP(const Framebuffer& render, const std::string& filename);
+/* Picks the format from the file extension (.png, .ppm or .bmp). */
+void saveRender(const Framebuffer& render, const std::string& filename,
+                const PNGEncodeSettings& settings = PNGEncodeSettings());
+
+/* Maps each normal component from [-1, 1] to [0, 1], like a normal map. */
+void saveNormalsToPNG(const NormalBuffer& normals, const std::string& filename);
+
+/* Closest surfaces are white, farthest ones are black. */
+void saveDepthToPNG(const DepthBuffer& depth, const std::string& filename);
 
-void saveRenderToPNG(const std::vector<std::vector<Color>>& render, const std::string& filename) {
-    int width = render[0].size();
-    int height = render.size();
+/* False-color rendering of a cost buffer, from black (cheapest) to white (most expensive).
+   The colormap saturates at the 99th percentile, so that a few outliers don't hide everything
+   else. */
+void saveCostHeatmapToPNG(const CostBuffer& cost, const std::string& filename);
 
-    std::vector<unsigned char> img(width * height * 3);
+/* HDR outputs, storing the linear radiance as is so that it can be tonemapped later on. */
+void saveRenderToPFM(const Framebuffer& render, const std::string& filename);
+Framebuffer loadRenderFromPFM(const std::string& filename);
+/* Radiance RGBE (.hdr) files, as commonly used for environment maps. */
+Framebuffer loadRenderFromHDR(const std::string& filename);
+/* Picks the format from the file extension (.pfm or .hdr). */
+Framebuffer loadRender(const std::string& filename);
+/* Single-channel PFM, for raw float buffers (depth, cost...). */
+void saveBufferToPFM(const Buffer2D<float>& buffer, const std::string& filename);
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int idx = 3 * (width * y + x);
-            img[idx] = to8Bit(render[y][x].r);
-            img[idx + 1] = to8Bit(render[y][x].g);
-            img[idx + 2] = to8Bit(render[y][x].b);
-        }
-    }
+/* Writes an uncompressed scanline OpenEXR file, with 16-bit (half) or 32-bit float channels. */
+void saveRenderToEXR(const Framebuffer& render, const std::string& filename,
+                     bool halfFloat = true);
 
-    lodepng::encode(filename, img, width, height, LCT_RGB);
-}
-#endif
\ No newline at end of file
+#endif
@@ -1,87 +1,329 @@
 #include "scene.hpp"
 #include "ray.hpp"
 #include "trace.hpp"
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <stdexcept>
 
-Color Scene::shootRay(const Ray& ray, int remainingBounces, bool isCameraRay) const {
-    const auto optIntersection = findFirstIntersection(ray);
+Scene::Scene(const std::vector<std::shared_ptr<Intersectable>>& nonLights,
+             const std::vector<std::shared_ptr<Intersectable>>& lights, const RenderParams& params,
+             const Color& skyColor)
+    : params(params), skyColor(skyColor) {
+    for (const auto& intersectable : nonLights) {
+        slots.push_back({intersectable, add(intersectable)});
+    }
+    for (const auto& light : lights) {
+        ObjectSlot slot{light, add(light)};
+        if (const auto* sphere = dynamic_cast<const Sphere*>(light.get())) {
+            slot.lightIndex = sphereLights.size();
+            sphereLights.push_back(*sphere);
+        } else {
+            slot.lightIndex = otherLights.size();
+            otherLights.push_back(light);
+        }
+        slots.push_back(slot);
+    }
+    buildLightSampler();
+}
 
-    if (!optIntersection) {
-        return skyColor;
+std::size_t Scene::add(const std::shared_ptr<Intersectable>& intersectable) {
+    if (const auto* sphere = dynamic_cast<const Sphere*>(intersectable.get())) {
+        spheres.push_back(*sphere);
+        return spheres.size() - 1;
+    }
+    if (const auto* movingSphere = dynamic_cast<const MovingSphere*>(intersectable.get())) {
+        movingSpheres.push_back(*movingSphere);
+        return movingSpheres.size() - 1;
+    }
+    if (const auto* plane = dynamic_cast<const Plane*>(intersectable.get())) {
+        planes.add(*plane);
+        return planes.size() - 1;
+    }
+    if (const auto* quad = dynamic_cast<const Quad*>(intersectable.get())) {
+        quads.push_back(*quad);
+        return quads.size() - 1;
+    }
+    if (const auto* box = dynamic_cast<const Box*>(intersectable.get())) {
+        boxes.push_back(*box);
+        return boxes.size() - 1;
     }
+    others.push_back(intersectable);
+    return others.size() - 1;
+}
 
-    const Intersection& intersection = optIntersection.value();
-    const Material& material = intersection.material.get();
-    Color irradiance;
-    bool clampIrradiance = (params.firefliesClamping && isCameraRay);
+void Scene::buildLightSampler() {
+    // The grid covers the bounded objects (where they were built) and the lights
+    constexpr float INF = std::numeric_limits<float>::infinity();
+    Point3 min(INF, INF, INF);
+    Point3 max(-INF, -INF, -INF);
+    auto grow = [&min, &max](const BoundingSphere& bounds) {
+        if (std::isinf(bounds.radius)) {
+            return;
+        }
+        const float r = bounds.radius;
+        const Point3& c = bounds.center;
+        min = Point3(std::min(min.x, c.x - r), std::min(min.y, c.y - r), std::min(min.z, c.z - r));
+        max = Point3(std::max(max.x, c.x + r), std::max(max.y, c.y + r), std::max(max.z, c.z + r));
+    };
 
-    if (material.type == MaterialType::Emissive) {
+    std::vector<LightSampler::Light> lights;
+    lightRadiance.clear();
+    auto addLight = [&](const Intersectable& light) {
+        const Color radiance = light.material.emission * light.material.color;
+        const float area = light.area();
+        lightRadiance.push_back(radiance);
+        // Lights of infinite area (planes) can't be sampled
+        lights.push_back({std::isinf(area) ? 0.0f : radiance.luminance() * area, light.bounds()});
+        grow(light.bounds());
+    };
+    for (const Sphere& light : sphereLights) {
+        addLight(light);
+    }
+    for (const auto& light : otherLights) {
+        addLight(*light);
+    }
+    for (const ObjectSlot& slot : slots) {
+        if (slot.lightIndex == ObjectSlot::NOT_A_LIGHT) {
+            grow(slot.original->bounds());
+        }
+    }
+    if (min.x > max.x) {
+        min = max = Point3(0.0f, 0.0f, 0.0f);
+    }
+    lightSampler = LightSampler(lights, min, max);
+}
+
+void Scene::setTranslation(std::size_t object, const Vector3& translation) {
+    const ObjectSlot& slot = slots.at(object);
+    const bool isLight = slot.lightIndex != ObjectSlot::NOT_A_LIGHT;
+    if (const auto* sphere = dynamic_cast<const Sphere*>(slot.original.get())) {
+        spheres[slot.index] = sphere->translated(translation);
+        if (isLight) {
+            sphereLights[slot.lightIndex] = spheres[slot.index];
+        }
+    } else if (const auto* movingSphere = dynamic_cast<const MovingSphere*>(slot.original.get())) {
+        movingSpheres[slot.index] = movingSphere->translated(translation);
+        if (isLight) {
+            otherLights[slot.lightIndex] =
+                std::make_shared<MovingSphere>(movingSpheres[slot.index]);
+        }
+    } else if (const auto* plane = dynamic_cast<const Plane*>(slot.original.get())) {
+        planes.set(slot.index, plane->translated(translation));
+    } else if (const auto* quad = dynamic_cast<const Quad*>(slot.original.get())) {
+        quads[slot.index] = quad->translated(translation);
+        if (isLight) {
+            otherLights[slot.lightIndex] = std::make_shared<Quad>(quads[slot.index]);
+        }
+    } else if (const auto* box = dynamic_cast<const Box*>(slot.original.get())) {
+        boxes[slot.index] = box->translated(translation);
+        if (isLight) {
+            otherLights[slot.lightIndex] = std::make_shared<Box>(boxes[slot.index]);
+        }
+    } else if (const auto* instance = dynamic_cast<const Instance*>(slot.original.get())) {
+        others[slot.index] = std::make_shared<Instance>(instance->translated(translation));
+        if (isLight) {
+            otherLights[slot.lightIndex] = others[slot.index];
+        }
+    } else {
+        throw std::runtime_error("Only built-in primitives and instances can be moved");
+    }
+    if (isLight) {
+        buildLightSampler();
+    }
+}
+
+template <typename Features>
+Color Scene::shootRay(const Ray& ray, int remainingBounces, RenderStats& stats, bool isCameraRay,
+                      SurfaceFeatures* features) const {
+    Ray searchRay = ray;
+    Intersection intersection;
+
+    if (!findFirstIntersection(searchRay, intersection, stats)) {
+        if (!environment) {
+            if (features) {
+                features->albedo = skyColor;
+                features->depth = ray.maxDist;
+            }
+            return skyColor;
+        }
+        // Like lights, the environment is already sampled from diffuse surfaces with next event
+        // estimation
+        if (Features::nextEventEstimation && ray.isDiffuse) {
+            return Color::BLACK;
+        }
+        const Color background = environment->lookup(ray.direction);
+        if (features) {
+            features->albedo = background;
+            features->depth = ray.maxDist;
+        }
+        return background;
+    }
+
+    const Material& material = *intersection.material;
+    if (features) {
+        features->albedo = material.type == MaterialType::Emissive
+                               ? (material.color * material.emission).clamped()
+                               : material.color;
+        features->normal = intersection.normal;
+        features->depth = intersection.distanceToRayOrigin;
+    }
+
+    const int n = remainingBounces;
+    switch (material.type) {
+    case MaterialType::Emissive:
+        return shadeHit<Features, MaterialType::Emissive>(ray, intersection, n, stats, isCameraRay);
+    case MaterialType::Diffuse:
+        return shadeHit<Features, MaterialType::Diffuse>(ray, intersection, n, stats, isCameraRay);
+    case MaterialType::Metal:
+        return shadeHit<Features, MaterialType::Metal>(ray, intersection, n, stats, isCameraRay);
+    case MaterialType::Refractive:
+        return shadeHit<Features, MaterialType::Refractive>(ray, intersection, n, stats,
+                                                            isCameraRay);
+    }
+    return Color::BLACK;
+}
+
+template <typename Features, MaterialType Type>
+Color Scene::shadeHit(const Ray& ray, const Intersection& intersection, int remainingBounces,
+                      RenderStats& stats, bool isCameraRay) const {
+    const Material& material = *intersection.material;
+
+    if constexpr (Type == MaterialType::Emissive) {
         Color li = material.color * material.emission;
 
         // If nextEventEstimation is activated and the ray comes from diffuse reflection, we
         // don't want to "double dip", i.e. count the direct diffuse lighting twice.
-        irradiance = (params.nextEventEstimation && ray.isDiffuse) ? Color::BLACK : li;
+        Color irradiance = (Features::nextEventEstimation && ray.isDiffuse) ? Color::BLACK : li;
 
         // We always want to clamp camera rays directly on lights to prevent aliasing.
-        clampIrradiance = clampIrradiance || isCameraRay;
+        return isCameraRay ? irradiance.clamped() : irradiance;
     } else {
-        Color direct = (params.nextEventEstimation && material.type == MaterialType::Diffuse)
-                           ? computeDirectDiffuseLighting(intersection)
-                           : Color::BLACK;
-        irradiance = direct;
+        Color irradiance;
+        if constexpr (Features::nextEventEstimation && Type == MaterialType::Diffuse) {
+            irradiance = computeDirectDiffuseLighting(intersection, ray.time, stats);
+        }
         if (remainingBounces > 0) {
-            auto [nextRay, attenuation] = reflectOrRefract(intersection, ray.origin);
-            Color indirect = attenuation * shootRay(nextRay, remainingBounces - 1);
+            auto [nextRay, attenuation] = reflectOrRefract<Type>(intersection, ray.origin);
+            nextRay.time = ray.time;
+            ++stats.bounceRays;
+            Color indirect = attenuation * shootRay<Features>(nextRay, remainingBounces - 1, stats);
             irradiance += indirect;
+        } else {
+            ++stats.maxBouncesTerminations;
         }
-    }
 
-    return clampIrradiance ? irradiance.clamped() : irradiance;
+        return (Features::firefliesClamping && isCameraRay) ? irradiance.clamped() : irradiance;
+    }
 }
 
-std::optional<Intersection> Scene::findFirstIntersection(const Ray& ray) const {
-    std::optional<Intersection> closestIntersection;
+template Color Scene::shootRay<IntegratorFeatures<false, false>>(const Ray&, int, RenderStats&,
+                                                                 bool, SurfaceFeatures*) const;
+template Color Scene::shootRay<IntegratorFeatures<false, true>>(const Ray&, int, RenderStats&,
+                                                                bool, SurfaceFeatures*) const;
+template Color Scene::shootRay<IntegratorFeatures<true, false>>(const Ray&, int, RenderStats&,
+                                                                bool, SurfaceFeatures*) const;
+template Color Scene::shootRay<IntegratorFeatures<true, true>>(const Ray&, int, RenderStats&,
+                                                               bool, SurfaceFeatures*) const;
 
-    for (const auto& intersectable : intersectables) {
-        auto intersection = intersectable->intersect(ray);
-        if (intersection &&
-            (!closestIntersection ||
-             intersection->distanceToRayOrigin < closestIntersection->distanceToRayOrigin)) {
-            closestIntersection = intersection;
-        }
+bool Scene::findFirstIntersection(Ray& ray, Intersection& hit, RenderStats& stats) const {
+    stats.sphereIntersectionTests += spheres.size() + movingSpheres.size();
+    stats.planeIntersectionTests += planes.size();
+    stats.otherIntersectionTests += quads.size() + boxes.size() + others.size();
+
+    // Each hit shrinks ray.maxDist, so only closer hits are recorded afterwards
+    bool found = planes.intersect(ray, hit);
+    for (const Sphere& sphere : spheres) {
+        found = sphere.intersect(ray, hit) || found;
+    }
+    for (const MovingSphere& sphere : movingSpheres) {
+        found = sphere.intersect(ray, hit) || found;
+    }
+    for (const Quad& quad : quads) {
+        found = quad.intersect(ray, hit) || found;
+    }
+    for (const Box& box : boxes) {
+        found = box.intersect(ray, hit) || found;
+    }
+    for (const auto& other : others) {
+        found = other->intersect(ray, hit) || found;
     }
 
-    return closestIntersection;
+    return found;
 }
 
-Color Scene::computeDirectDiffuseLighting(const Intersection& intersection) const {
-    Color intersectionColor{0.0f};
-    const Material& material = intersection.material.get();
+Color Scene::computeDirectDiffuseLighting(const Intersection& intersection, float time,
+                                          RenderStats& stats) const {
+    Color lighting{0.0f};
+    lightSampler.forEachSelectedLight(
+        intersection.location, Utils::random(), [&](std::size_t light, float probability) {
+            const Color& radiance = lightRadiance[light];
+            lighting += (light < sphereLights.size()
+                             ? directLightingFrom(sphereLights[light], radiance, intersection,
+                                                  time, stats)
+                             : directLightingFrom(*otherLights[light - sphereLights.size()],
+                                                  radiance, intersection, time, stats)) /
+                        probability;
+        });
+    if (environment) {
+        lighting += directLightingFromEnvironment(intersection, time, stats);
+    }
+    return lighting;
+}
 
-    Color brdf = material.color / Utils::PI;
-    for (const auto& light : lights) {
-        PointSamplingResult sample = light->sampleForDirectLighting(intersection.location);
-        Vector3 toLight = sample.point - intersection.location;
-        Vector3 toLightNormalized = toLight.normalized();
-        float lightDotN = toLightNormalized.dot(intersection.normal);
+Color Scene::directLightingFromEnvironment(const Intersection& intersection, float time,
+                                           RenderStats& stats) const {
+    const EnvironmentMap::Sample sample = environment->sample();
+    const float lightDotN = sample.direction.dot(intersection.normal);
+    if (lightDotN <= 0.0f || sample.pdf <= 0.0f) {
+        return Color::BLACK;
+    }
 
-        if (lightDotN <= 0.0f) {
-            continue;
-        }
+    // The environment is behind everything : any hit occludes it
+    Ray rayTowardsLight{intersection.location, sample.direction};
+    rayTowardsLight.time = time;
 
-        // Checking for occlusion between the intersection and light
-        Ray rayTowardsLight{intersection.location, toLightNormalized};
-        rayTowardsLight.maxDist = (sample.point - intersection.location).length() -
-                                  Ray::MIN_RAY_DIST; // preventing auto-occlusion
+    ++stats.shadowRays;
+    Intersection occluder;
+    if (findFirstIntersection(rayTowardsLight, occluder, stats)) {
+        ++stats.occludedShadowRays;
+        return Color::BLACK;
+    }
 
-        if (findFirstIntersection(rayTowardsLight)) {
-            continue;
-        }
+    Color brdf = intersection.material->color / Utils::PI;
+    return brdf * sample.radiance * lightDotN / sample.pdf;
+}
+
+/* Light is either a final primitive type, whose calls are devirtualized, or Intersectable. */
+template <typename Light>
+Color Scene::directLightingFrom(const Light& light, const Color& radiance,
+                                const Intersection& intersection, float time,
+                                RenderStats& stats) const {
+    const Material& material = *intersection.material;
+    PointSamplingResult sample = light.sampleForDirectLighting(intersection.location, time);
+    Vector3 toLight = sample.point - intersection.location;
+    Vector3 toLightNormalized = toLight.normalized();
+    float lightDotN = toLightNormalized.dot(intersection.normal);
+
+    if (lightDotN <= 0.0f) {
+        return Color::BLACK;
+    }
 
-        Color li = sample.normal.dot(-toLightNormalized) * light->material.emission *
-                   light->material.color;
+    // Checking for occlusion between the intersection and light
+    Ray rayTowardsLight{intersection.location, toLightNormalized};
+    rayTowardsLight.maxDist = (sample.point - intersection.location).length() -
+                              Ray::MIN_RAY_DIST; // preventing auto-occlusion
+    rayTowardsLight.time = time;
 
-        intersectionColor += brdf * li * lightDotN / (sample.pdf * toLight.lengthSquared());
+    ++stats.shadowRays;
+    Intersection occluder;
+    if (findFirstIntersection(rayTowardsLight, occluder, stats)) {
+        ++stats.occludedShadowRays;
+        return Color::BLACK;
     }
-    return intersectionColor;
-}
\ No newline at end of file
+
+    Color brdf = material.color / Utils::PI;
+    Color li = sample.normal.dot(-toLightNormalized) * radiance;
+
+    return brdf * li * lightDotN / (sample.pdf * toLight.lengthSquared());
+}
@@ -2,35 +2,105 @@
 #define SCENE_HPP
 
 #include "color.hpp"
+#include "environment.hpp"
 #include "intersectable.hpp"
 #include "intersection.hpp"
+#include "lightsampler.hpp"
 #include "params.hpp"
 #include "ray.hpp"
+#include "stats.hpp"
+#include <cstddef>
 #include <memory>
 #include <utility>
 #include <vector>
 
+/* First-hit surface attributes of a camera ray, used as feature buffers by the denoiser. */
+struct SurfaceFeatures {
+    Color albedo;
+    Vector3 normal{0.0f, 0.0f, 0.0f};
+    float depth = 0.0f;
+};
+
+/* Integrator options fixed at compile time, so that shootRay doesn't branch on them at every
+   bounce. Renders pick their variant once, see selectTileRenderer. */
+template <bool NextEventEstimation, bool FirefliesClamping> struct IntegratorFeatures {
+    constexpr static bool nextEventEstimation = NextEventEstimation;
+    constexpr static bool firefliesClamping = FirefliesClamping;
+};
+
 class Scene {
-    /* Holds all Intersectable objects, including the lights. */
-    std::vector<std::shared_ptr<Intersectable>> intersectables;
-    std::vector<std::shared_ptr<Intersectable>> lights;
+    /* Built-in primitives (including lights) are stored by value and grouped by type, so that
+       they are intersected in tight loops without virtual calls. Other Intersectable types are
+       kept behind their interface. */
+    // Unbounded objects, tested first : the closest plane bounds the search among the others.
+    PlaneSet planes;
+    std::vector<Sphere> spheres;
+    std::vector<MovingSphere> movingSpheres;
+    std::vector<Quad> quads;
+    std::vector<Box> boxes;
+    std::vector<std::shared_ptr<Intersectable>> others;
+    std::vector<Sphere> sphereLights;
+    std::vector<std::shared_ptr<Intersectable>> otherLights;
     RenderParams params;
+    // Emitted radiance of the lights (sphereLights, then otherLights), and which one to sample
+    std::vector<Color> lightRadiance;
+    LightSampler lightSampler;
+
+    /* Where each object given to the constructor is stored, so that it can be moved in place. */
+    struct ObjectSlot {
+        constexpr static std::size_t NOT_A_LIGHT = static_cast<std::size_t>(-1);
+
+        std::shared_ptr<Intersectable> original;
+        // In the array of its type, and in sphereLights or otherLights
+        std::size_t index;
+        std::size_t lightIndex = NOT_A_LIGHT;
+    };
+    std::vector<ObjectSlot> slots;
 
   public:
     Color skyColor;
+    /* If set, replaces skyColor, and is sampled as a light by next event estimation. */
+    std::shared_ptr<const EnvironmentMap> environment;
 
     Scene(const std::vector<std::shared_ptr<Intersectable>>& nonLights,
           const std::vector<std::shared_ptr<Intersectable>>& lights, const RenderParams& params,
-          const Color& skyColor = Color(0.7f, 0.9f, 1.0f))
-        : intersectables(nonLights), lights(lights), params(params), skyColor(skyColor) {
-        intersectables.insert(intersectables.end(), lights.begin(), lights.end());
-    }
+          const Color& skyColor = Color(0.7f, 0.9f, 1.0f));
+
+    /* Objects are numbered in the order given to the constructor, lights coming last. */
+    std::size_t objectCount() const { return slots.size(); }
+    /* Places the object at its original position moved by translation. Only the arrays holding
+       it are updated, the rest of the scene is reused as is. Throws for objects that are not
+       built-in primitives. */
+    void setTranslation(std::size_t object, const Vector3& translation);
 
-    Color shootRay(const Ray& ray, int remainingBounces, bool isCameraRay = false) const;
-    std::optional<Intersection> findFirstIntersection(const Ray& ray) const;
+    /* If features is non-null, it is filled with the attributes of the first surface hit.
+       Instantiated for every IntegratorFeatures. */
+    template <typename Features>
+    Color shootRay(const Ray& ray, int remainingBounces, RenderStats& stats,
+                   bool isCameraRay = false, SurfaceFeatures* features = nullptr) const;
+    /* Shrinks ray.maxDist to the distance of the closest hit, which is written to hit. */
+    bool findFirstIntersection(Ray& ray, Intersection& hit, RenderStats& stats) const;
 
   private:
-    Color computeDirectDiffuseLighting(const Intersection& intersection) const;
+    /* Returns the index of the object in the array of its type. */
+    std::size_t add(const std::shared_ptr<Intersectable>& intersectable);
+    /* Shading of a hit on a material of type Type : shootRay branches on the type of the
+       material once, and each type gets its own code without further checks. */
+    template <typename Features, MaterialType Type>
+    Color shadeHit(const Ray& ray, const Intersection& intersection, int remainingBounces,
+                   RenderStats& stats, bool isCameraRay) const;
+    /* Precomputes the radiance and power of the lights, and their sampling tables. */
+    void buildLightSampler();
+    /* Samples the lights selected by lightSampler, and the environment. time is the time of the
+       ray which hit the intersection. */
+    Color computeDirectDiffuseLighting(const Intersection& intersection, float time,
+                                       RenderStats& stats) const;
+    template <typename Light>
+    Color directLightingFrom(const Light& light, const Color& radiance,
+                             const Intersection& intersection, float time,
+                             RenderStats& stats) const;
+    Color directLightingFromEnvironment(const Intersection& intersection, float time,
+                                        RenderStats& stats) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "stats.hpp"
+#include <sstream>
+
+RenderStats& RenderStats::operator+=(const RenderStats& other) {
+    cameraRays += other.cameraRays;
+    bounceRays += other.bounceRays;
+    shadowRays += other.shadowRays;
+    occludedShadowRays += other.occludedShadowRays;
+    sphereIntersectionTests += other.sphereIntersectionTests;
+    planeIntersectionTests += other.planeIntersectionTests;
+    otherIntersectionTests += other.otherIntersectionTests;
+    maxBouncesTerminations += other.maxBouncesTerminations;
+    return *this;
+}
+
+std::string RenderStats::toJSON() const {
+    const double raysPerSecond = renderSeconds > 0.0 ? totalRays() / renderSeconds : 0.0;
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"renderSeconds\": " << renderSeconds << ",\n"
+         << "  \"threads\": " << threads << ",\n"
+         << "  \"rays\": {\n"
+         << "    \"camera\": " << cameraRays << ",\n"
+         << "    \"bounce\": " << bounceRays << ",\n"
+         << "    \"shadow\": " << shadowRays << ",\n"
+         << "    \"occludedShadow\": " << occludedShadowRays << ",\n"
+         << "    \"total\": " << totalRays() << ",\n"
+         << "    \"perSecond\": " << raysPerSecond << "\n"
+         << "  },\n"
+         << "  \"intersectionTests\": {\n"
+         << "    \"sphere\": " << sphereIntersectionTests << ",\n"
+         << "    \"plane\": " << planeIntersectionTests << ",\n"
+         << "    \"other\": " << otherIntersectionTests << ",\n"
+         << "    \"total\": " << totalIntersectionTests() << "\n"
+         << "  },\n"
+         << "  \"maxBouncesTerminations\": " << maxBouncesTerminations << "\n"
+         << "}\n";
+    return json.str();
+}
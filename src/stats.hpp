@@ -0,0 +1,33 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <cstdint>
+#include <string>
+
+/* Counters of the work done by a render. Each thread fills its own instance, aligned to a cache
+   line to prevent false sharing, and they are summed up at the end of the render. */
+struct alignas(64) RenderStats {
+    uint64_t cameraRays = 0;
+    // Rays spawned by reflection or refraction
+    uint64_t bounceRays = 0;
+    uint64_t shadowRays = 0;
+    uint64_t occludedShadowRays = 0;
+    uint64_t sphereIntersectionTests = 0;
+    uint64_t planeIntersectionTests = 0;
+    uint64_t otherIntersectionTests = 0;
+    // Paths that hit a non-emissive surface with no bounce left
+    uint64_t maxBouncesTerminations = 0;
+    double renderSeconds = 0.0;
+    int threads = 0;
+
+    RenderStats& operator+=(const RenderStats& other);
+
+    uint64_t totalRays() const { return cameraRays + bounceRays + shadowRays; }
+    uint64_t totalIntersectionTests() const {
+        return sphereIntersectionTests + planeIntersectionTests + otherIntersectionTests;
+    }
+
+    std::string toJSON() const;
+};
+
+#endif
@@ -0,0 +1,195 @@
+#include "threads.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace {
+struct CPU {
+    int id;
+    int node;
+    int package;
+    int core;
+};
+
+int readInt(const std::string& path, int fallback) {
+    std::ifstream file(path);
+    int value = fallback;
+    file >> value;
+    return file ? value : fallback;
+}
+
+/* Parses a sysfs CPU list such as "0-3,8-11". */
+std::vector<int> parseCPUList(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        const std::size_t dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<CPU> detectCPUs() {
+    std::vector<CPU> cpus;
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        std::map<int, int> nodeOfCPU;
+        for (int node = 0;; ++node) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) +
+                               "/cpulist");
+            std::string list;
+            if (!std::getline(file, list)) {
+                break;
+            }
+            for (int cpu : parseCPUList(list)) {
+                nodeOfCPU[cpu] = node;
+            }
+        }
+
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &allowed)) {
+                continue;
+            }
+            const std::string topology =
+                "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+            cpus.push_back({cpu, nodeOfCPU.count(cpu) ? nodeOfCPU[cpu] : 0,
+                            readInt(topology + "physical_package_id", 0),
+                            readInt(topology + "core_id", cpu)});
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        const int nCPUs = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < nCPUs; ++cpu) {
+            cpus.push_back({cpu, 0, 0, cpu});
+        }
+    }
+    return cpus;
+}
+
+void overrideFromEnvironment(const char* name, int& value) {
+    if (const char* env = std::getenv(name)) {
+        value = std::atoi(env);
+    }
+}
+
+void overrideFromEnvironment(const char* name, bool& value) {
+    if (const char* env = std::getenv(name)) {
+        value = std::string(env) != "0";
+    }
+}
+} // namespace
+
+ThreadPolicy ThreadPolicy::withEnvironmentOverrides() const {
+    ThreadPolicy policy = *this;
+    overrideFromEnvironment("RAYTRACER_THREADS", policy.threads);
+    overrideFromEnvironment("RAYTRACER_SMT", policy.useSMT);
+    overrideFromEnvironment("RAYTRACER_PIN", policy.pinThreads);
+    overrideFromEnvironment("RAYTRACER_NUMA", policy.numaAware);
+    return policy;
+}
+
+ThreadLayout makeThreadLayout(const ThreadPolicy& policy) {
+    std::vector<CPU> cpus = detectCPUs();
+    std::sort(cpus.begin(), cpus.end(), [](const CPU& c1, const CPU& c2) {
+        return std::tie(c1.node, c1.package, c1.core, c1.id) <
+               std::tie(c2.node, c2.package, c2.core, c2.id);
+    });
+
+    if (!policy.useSMT) {
+        // Only keeps the first logical CPU of each core
+        std::set<std::pair<int, int>> cores;
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                                  [&cores](const CPU& cpu) {
+                                      return !cores.insert({cpu.package, cpu.core}).second;
+                                  }),
+                   cpus.end());
+    }
+
+    ThreadLayout layout;
+    layout.nThreads = policy.threads > 0 ? policy.threads : static_cast<int>(cpus.size());
+    // Spreads threads evenly over the CPUs, keeping threads of a same node contiguous
+    for (int thread = 0; thread < layout.nThreads; ++thread) {
+        const CPU& cpu = cpus[static_cast<std::size_t>(thread) * cpus.size() / layout.nThreads];
+        layout.cpuOfThread.push_back(cpu.id);
+        layout.nodeOfThread.push_back(cpu.node);
+    }
+
+    // Renumbers the nodes that are actually used as 0, 1, 2...
+    std::map<int, int> nodeIndices;
+    for (int& node : layout.nodeOfThread) {
+        node = nodeIndices.insert({node, static_cast<int>(nodeIndices.size())}).first->second;
+    }
+    layout.nNodes = static_cast<int>(nodeIndices.size());
+    return layout;
+}
+
+void pinCurrentThread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+}
+
+TileScheduler::TileScheduler(int nTileRows, int nTileColumns, const ThreadLayout& layout,
+                             bool numaAware)
+    : nBands(numaAware ? layout.nNodes : 1) {
+    std::vector<int> threadsOfBand(nBands, 0);
+    for (int thread = 0; thread < layout.nThreads; ++thread) {
+        const int band = numaAware ? layout.nodeOfThread[thread] : 0;
+        bandOfThread.push_back(band);
+        ++threadsOfBand[band];
+    }
+
+    int threadsBefore = 0;
+    for (int band = 0; band < nBands; ++band) {
+        firstTileOfBand.push_back(threadsBefore * nTileRows / layout.nThreads * nTileColumns);
+        threadsBefore += threadsOfBand[band];
+    }
+    firstTileOfBand.push_back(nTileRows * nTileColumns);
+
+    nextTileOfBand = std::make_unique<std::atomic<int>[]>(nBands);
+    reset();
+}
+
+void TileScheduler::reset() {
+    for (int band = 0; band < nBands; ++band) {
+        nextTileOfBand[band] = firstTileOfBand[band];
+    }
+}
+
+int TileScheduler::nextTile(int thread) {
+    const int ownBand = bandOfThread[thread];
+    for (int i = 0; i < nBands; ++i) {
+        const int band = (ownBand + i) % nBands;
+        if (nextTileOfBand[band].load(std::memory_order_relaxed) >= firstTileOfBand[band + 1]) {
+            continue;
+        }
+        const int tile = nextTileOfBand[band].fetch_add(1, std::memory_order_relaxed);
+        if (tile < firstTileOfBand[band + 1]) {
+            return tile;
+        }
+    }
+    return -1;
+}
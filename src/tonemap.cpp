@@ -0,0 +1,66 @@
+#include "tonemap.hpp"
+#include "profiler.hpp"
+#include "utils.hpp"
+#include <cmath>
+#include <cstddef>
+
+namespace {
+float reinhard(float x) { return x / (1.0f + x); }
+
+/* Krzysztof Narkowicz's fit of the ACES filmic curve. */
+float aces(float x) {
+    constexpr float a = 2.51f, b = 0.03f, c = 2.43f, d = 0.59f, e = 0.14f;
+    return Utils::clamp((x * (a * x + b)) / (x * (c * x + d) + e));
+}
+
+/* Tonemapping without the gamma correction. */
+Color applyOperator(const Color& radiance, float exposureScale, ToneMapOperator toneMapOperator) {
+    Color exposed = radiance * exposureScale;
+    Color mapped;
+    switch (toneMapOperator) {
+    case ToneMapOperator::Reinhard:
+        mapped = Color(reinhard(exposed.r), reinhard(exposed.g), reinhard(exposed.b));
+        break;
+    case ToneMapOperator::ACES:
+        mapped = Color(aces(exposed.r), aces(exposed.g), aces(exposed.b));
+        break;
+    case ToneMapOperator::Clamp:
+        mapped = exposed.clamped();
+        break;
+    }
+    return mapped;
+}
+} // namespace
+
+Color gammaCorrect(const Color& color, float gamma) {
+    float exponent = 1.0f / gamma;
+    return Color(FastMath::pow(color.r, exponent), FastMath::pow(color.g, exponent),
+                 FastMath::pow(color.b, exponent));
+}
+
+Color gammaCorrect(const Color& color, const FastMath::GammaCurve& curve) {
+    return Color(curve(color.r), curve(color.g), curve(color.b));
+}
+
+Color tonemap(const Color& radiance, const ToneMapParams& params) {
+    return gammaCorrect(
+        applyOperator(radiance, std::exp2(params.exposure), params.toneMapOperator),
+        params.gamma);
+}
+
+Framebuffer tonemap(const Framebuffer& linear, const ToneMapParams& params) {
+    PROFILE_SCOPE("tonemap");
+    Framebuffer mapped(linear.width, linear.height);
+    const float exposureScale = std::exp2(params.exposure);
+    const FastMath::GammaCurve curve(params.gamma);
+    const auto nPixels = static_cast<long>(linear.pixels.size());
+
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+    for (long i = 0; i < nPixels; ++i) {
+        mapped.pixels[i] = gammaCorrect(
+            applyOperator(linear.pixels[i], exposureScale, params.toneMapOperator), curve);
+    }
+    return mapped;
+}
@@ -0,0 +1,24 @@
+#ifndef TONEMAP_HPP
+#define TONEMAP_HPP
+
+#include "color.hpp"
+#include "fastmath.hpp"
+#include "framebuffer.hpp"
+
+enum ToneMapOperator { Clamp, Reinhard, ACES };
+
+/* Turns linear radiance into display-ready colors in [0, 1]. Exposure is in stops. */
+struct ToneMapParams {
+    float exposure = 0.0f;
+    float gamma = 2.2f;
+    ToneMapOperator toneMapOperator = ToneMapOperator::Clamp;
+};
+
+Color gammaCorrect(const Color& color, float gamma);
+/* Faster when correcting many colors with the same gamma. */
+Color gammaCorrect(const Color& color, const FastMath::GammaCurve& curve);
+
+Color tonemap(const Color& radiance, const ToneMapParams& params);
+Framebuffer tonemap(const Framebuffer& linear, const ToneMapParams& params = ToneMapParams());
+
+#endif
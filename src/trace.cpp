@@ -1,15 +1,23 @@
 #include "trace.hpp"
+#include "accumulator.hpp"
 #include "camera.hpp"
+#include "checkpoint.hpp"
 #include "params.hpp"
+#include "profiler.hpp"
 #include "ray.hpp"
 #include "sampling.hpp"
 #include "scene.hpp"
+#include "threads.hpp"
 #include "utils.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <omp.h>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <utility>
 
 std::string progressBar(float progressRatio) {
     constexpr int nChars = 50;
@@ -25,49 +33,253 @@ std::string progressBar(float progressRatio) {
     return progressBar.str();
 }
 
-Color gammaCorrect(const Color& color, float gamma) {
-    float exponent = 1.0f / gamma;
-    return Color(std::pow(color.r, exponent), std::pow(color.g, exponent),
-                 std::pow(color.b, exponent));
+std::vector<Tile> makeTiles(int width, int height, int tileSize) {
+    return makeTiles(PixelRect{0, 0, width, height}, tileSize);
 }
 
-std::vector<std::vector<Color>> rayTrace(const PerspectiveCamera& camera, const Scene& scene,
-                                         const RenderParams& params) {
-    std::vector<std::vector<Color>> render(params.height);
+std::vector<Tile> makeTiles(const PixelRect& region, int tileSize) {
+    std::vector<Tile> tiles;
+    for (int y = region.y0; y < region.y1; y += tileSize) {
+        for (int x = region.x0; x < region.x1; x += tileSize) {
+            tiles.push_back(
+                {x, y, std::min(x + tileSize, region.x1), std::min(y + tileSize, region.y1)});
+        }
+    }
+    return tiles;
+}
+
+namespace {
+template <typename Features>
+void renderTileWith(const PerspectiveCamera& camera, const Scene& scene,
+                    const RenderParams& params, const Tile& tile, int targetSamples,
+                    Accumulator& accumulator, RenderStats& stats) {
+    // Camera rays are generated for the whole tile at once, from the fewest samples any of its
+    // pixels has (usually all of them have the same number).
+    int firstSample = targetSamples;
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        for (int x = tile.x0; x < tile.x1; ++x) {
+            firstSample = std::min(
+                firstSample, accumulator.samples(x - accumulator.x0, y - accumulator.y0));
+        }
+    }
+    if (firstSample >= targetSamples) {
+        return;
+    }
+    const int batchSamples = targetSamples - firstSample;
+    thread_local CameraRayBatch cameraRays;
+    camera.generateRays(tile.x0, tile.y0, tile.x1, tile.y1, firstSample, batchSamples,
+                        accumulator.seed, params.width, params.height, cameraRays);
+
+    int pixelInTile = 0;
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        for (int x = tile.x0; x < tile.x1; ++x, ++pixelInTile) {
+            const int ax = x - accumulator.x0;
+            const int ay = y - accumulator.y0;
+            int& nSamples = accumulator.samples(ax, ay);
+            if (nSamples >= targetSamples) {
+                continue;
+            }
+            // Each pixel and pass has its own random sequence, which makes renders reproducible
+            // regardless of the number of threads, of the tile order or of interruptions. The
+            // first sample of the pass selects the stream, so passes never share a sequence.
+            const auto pixelIndex = static_cast<uint64_t>(y) * params.width + x;
+            Utils::seedRandom(accumulator.seed ^ Utils::hash(pixelIndex),
+                              static_cast<uint64_t>(nSamples));
+
+            const auto pixelStart = params.pixelCost == PixelCost::Time
+                                        ? std::chrono::steady_clock::now()
+                                        : std::chrono::steady_clock::time_point();
+            const uint64_t raysBefore = stats.totalRays();
+
+            Color pixelColor{0.0f};
+            Color albedo{0.0f};
+            Vector3 normal{0.0f, 0.0f, 0.0f};
+            float depth = 0.0f;
+            for (int i = nSamples; i < targetSamples; ++i) {
+                const Ray initialRay =
+                    cameraRays.ray(pixelInTile * batchSamples + (i - firstSample));
+                SurfaceFeatures features;
+                ++stats.cameraRays;
+                pixelColor += scene.shootRay<Features>(initialRay, params.maxBounces, stats,
+                                                       true, &features);
+                albedo += features.albedo;
+                normal += features.normal;
+                depth += features.depth;
+            }
+            if (params.compensatedAccumulation) {
+                accumulator.addRadianceCompensated(ax, ay, pixelColor);
+            } else {
+                accumulator.radiance(ax, ay) += pixelColor;
+            }
+            accumulator.albedo(ax, ay) += albedo;
+            accumulator.normal(ax, ay) += normal;
+            accumulator.depth(ax, ay) += depth;
+            nSamples = targetSamples;
+
+            if (params.pixelCost == PixelCost::Time) {
+                accumulator.cost(ax, ay) +=
+                    std::chrono::duration<float>(std::chrono::steady_clock::now() - pixelStart)
+                        .count();
+            } else if (params.pixelCost == PixelCost::Rays) {
+                accumulator.cost(ax, ay) += static_cast<float>(stats.totalRays() - raysBefore);
+            }
+        }
+    }
+}
+
+} // namespace
+
+TileRenderer selectTileRenderer(const RenderParams& params) {
+    if (params.nextEventEstimation) {
+        return params.firefliesClamping ? renderTileWith<IntegratorFeatures<true, true>>
+                                        : renderTileWith<IntegratorFeatures<true, false>>;
+    }
+    return params.firefliesClamping ? renderTileWith<IntegratorFeatures<false, true>>
+                                    : renderTileWith<IntegratorFeatures<false, false>>;
+}
+
+void renderTile(const PerspectiveCamera& camera, const Scene& scene, const RenderParams& params,
+                const Tile& tile, int targetSamples, Accumulator& accumulator,
+                RenderStats& stats) {
+    selectTileRenderer(params)(camera, scene, params, tile, targetSamples, accumulator, stats);
+}
+
+void renderTilePasses(const PerspectiveCamera& camera, const Scene& scene,
+                      const RenderParams& params, const Tile& tile, Accumulator& accumulator,
+                      RenderStats& stats) {
+    const TileRenderer renderTile = selectTileRenderer(params);
+    int samples = accumulator.samples(tile.x0 - accumulator.x0, tile.y0 - accumulator.y0);
+    while (samples < params.nSamples) {
+        samples = std::min((samples / params.samplesPerPass + 1) * params.samplesPerPass,
+                           params.nSamples);
+        renderTile(camera, scene, params, tile, samples, accumulator, stats);
+    }
+}
 
+namespace {
+/* Renders params.region(), into a result of the size of the region. */
+RenderResult renderRegion(const PerspectiveCamera& camera, const Scene& scene,
+                          const RenderParams& params) {
+    const TileRenderer renderTile = selectTileRenderer(params);
+    const ThreadPolicy policy = params.threadPolicy.withEnvironmentOverrides();
+    const ThreadLayout layout = makeThreadLayout(policy);
 #if defined(_OPENMP)
-    // This may need tweaking for optimal performance depending on your machine :
-    // I noticed that using hyperthreading (all 8 logical cores) resulted in 10-15%
-    // worse performance on my machine than just using the 4 physical cores.
-    const int num_threads = omp_get_max_threads() / 2;
+    const int num_threads = layout.nThreads;
     omp_set_num_threads(num_threads);
 #else
     const int num_threads = 1;
 #endif
 
-    std::cout << "Starting render on " << num_threads << " threads..." << std::endl;
+    const PixelRect region = params.region();
+    const std::vector<Tile> tiles = makeTiles(region, params.tileSize);
+    const int nTiles = static_cast<int>(tiles.size());
+    const int nTileColumns = (region.width() + params.tileSize - 1) / params.tileSize;
+    const int nTileRows = (region.height() + params.tileSize - 1) / params.tileSize;
+    TileScheduler scheduler(nTileRows, nTileColumns, layout, policy.numaAware);
+
+    // Resumed renders are not first touched : their checkpoint is loaded by the main thread.
+    std::optional<Accumulator> resumed = resumeFromCheckpoint(params);
+    const bool firstTouch = policy.numaAware && !resumed;
+    Accumulator accumulator =
+        resumed ? std::move(*resumed)
+                : (firstTouch ? Accumulator(region.width(), region.height(), params.seed,
+                                            Uninitialized(), region.x0, region.y0)
+                              : Accumulator(region.width(), region.height(), params.seed,
+                                            region.x0, region.y0));
+
+#if defined(_OPENMP)
+#pragma omp parallel
+    {
+        const int thread = omp_get_thread_num();
+        if (policy.pinThreads || policy.numaAware) {
+            pinCurrentThread(layout.cpuOfThread[thread]);
+        }
+        if (firstTouch) {
+            // The rows of a band are shared between the threads of its node
+            const int band = scheduler.bandOf(thread);
+            int indexInBand = 0;
+            int nThreadsInBand = 0;
+            for (int other = 0; other < num_threads; ++other) {
+                if (scheduler.bandOf(other) == band) {
+                    indexInBand += other < thread ? 1 : 0;
+                    ++nThreadsInBand;
+                }
+            }
+            const int bandStart = scheduler.firstTileRow(band, nTileColumns) * params.tileSize;
+            const int bandEnd = std::min(
+                scheduler.lastTileRow(band, nTileColumns) * params.tileSize, region.height());
+            const int bandHeight = bandEnd - bandStart;
+            accumulator.clearRows(bandStart + bandHeight * indexInBand / nThreadsInBand,
+                                  bandStart + bandHeight * (indexInBand + 1) / nThreadsInBand);
+        }
+    }
+#else
+    if (firstTouch) {
+        accumulator.clearRows(0, region.height());
+    }
+#endif
+
+    std::cout << "Starting render on " << num_threads << " threads";
+    if (policy.numaAware) {
+        std::cout << " (" << layout.nNodes << " NUMA nodes)";
+    }
+    std::cout << "..." << std::endl;
     const auto start = std::chrono::steady_clock::now();
+    auto lastCheckpoint = start;
 
-    for (int y = 0; y < params.height; ++y) {
-        std::vector<Color> line(params.width);
-        std::string bar = progressBar(static_cast<float>(y) / static_cast<float>(params.height));
-        std::cout << '\r' << bar << std::flush;
+    const int nPasses = (params.nSamples + params.samplesPerPass - 1) / params.samplesPerPass;
+    std::vector<RenderStats> threadStats(num_threads);
+
+    for (int pass = 0; pass < nPasses; ++pass) {
+        PROFILE_SCOPE("pass", pass);
+        const int targetSamples = std::min((pass + 1) * params.samplesPerPass, params.nSamples);
+        int tilesDone = 0;
+        scheduler.reset();
 
 #if defined(_OPENMP)
-#pragma omp parallel for schedule(guided)
+#pragma omp parallel
 #endif
-        for (int x = 0; x < params.width; ++x) {
-            Color pixelColor{0.0f};
-            for (int i = 0; i < params.nSamples; ++i) {
-                auto sampledPixel = Utils::randomOffsetPixel(x, y); // to prevent aliasing
-                Ray initialRay = camera.makeRay(sampledPixel.first, sampledPixel.second,
-                                                params.width, params.height);
-                pixelColor += scene.shootRay(initialRay, params.maxBounces, true);
+        {
+#if defined(_OPENMP)
+            const int thread = omp_get_thread_num();
+#else
+            const int thread = 0;
+#endif
+            RenderStats& stats = threadStats[thread];
+            for (int i = scheduler.nextTile(thread); i >= 0; i = scheduler.nextTile(thread)) {
+                {
+                    PROFILE_SCOPE("tile", i);
+                    renderTile(camera, scene, params, tiles[i], targetSamples, accumulator, stats);
+                }
+
+#if defined(_OPENMP)
+#pragma omp critical(progress)
+#endif
+                {
+                    PROFILE_SCOPE("progress output");
+                    ++tilesDone;
+                    const float progress = static_cast<float>(pass * nTiles + tilesDone) /
+                                           static_cast<float>(nPasses * nTiles);
+                    std::cout << '\r' << progressBar(progress) << std::flush;
+                }
             }
-            pixelColor /= params.nSamples;
-            line[x] = gammaCorrect((pixelColor).clamped(), params.gamma);
+
+            // Time spent by threads waiting for the last tiles of the pass
+            PROFILE_SCOPE("end of pass barrier", pass);
+#if defined(_OPENMP)
+#pragma omp barrier
+#endif
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const bool lastPass = pass == nPasses - 1;
+        if (!params.checkpointFile.empty() &&
+            (lastPass || std::chrono::duration<float>(now - lastCheckpoint).count() >=
+                             params.checkpointInterval)) {
+            PROFILE_SCOPE("checkpoint");
+            saveCheckpoint(accumulator, params.checkpointFile);
+            lastCheckpoint = now;
         }
-        render[y] = line;
     }
 
     const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -75,5 +287,49 @@ std::vector<std::vector<Color>> rayTrace(const PerspectiveCamera& camera, const
     std::cout << "\nScene rendered in " << static_cast<float>(duration.count()) / 1000.0f
               << " seconds.\n";
 
+    PROFILE_SCOPE("resolve");
+    RenderResult render = accumulator.resolve();
+    for (const RenderStats& stats : threadStats) {
+        render.stats += stats;
+    }
+    render.stats.renderSeconds = static_cast<double>(duration.count()) / 1000.0;
+    render.stats.threads = num_threads;
     return render;
 }
+} // namespace
+
+RenderResult rayTrace(const PerspectiveCamera& camera, const Scene& scene,
+                      const RenderParams& params) {
+    PROFILE_SCOPE("rayTrace");
+    const PixelRect region = params.region();
+    RenderResult regionRender = renderRegion(camera, scene, params);
+    if (region.width() == params.width && region.height() == params.height) {
+        return regionRender;
+    }
+
+    RenderResult render(params.width, params.height);
+    render.paste(regionRender, region.x0, region.y0);
+    render.stats = regionRender.stats;
+    return render;
+}
+
+void rayTraceRegions(const PerspectiveCamera& camera, const Scene& scene,
+                     const RenderParams& params, const std::vector<PixelRect>& regions,
+                     RenderResult& render) {
+    PROFILE_SCOPE("rayTraceRegions");
+    RenderParams regionParams = params;
+    regionParams.checkpointFile.clear();
+    regionParams.resume = false;
+
+    RenderStats stats;
+    for (const PixelRect& cropWindow : regions) {
+        regionParams.cropWindow = cropWindow;
+        const PixelRect region = regionParams.region();
+        const RenderResult regionRender = renderRegion(camera, scene, regionParams);
+        render.paste(regionRender, region.x0, region.y0);
+        stats += regionRender.stats;
+        stats.renderSeconds += regionRender.stats.renderSeconds;
+        stats.threads = regionRender.stats.threads;
+    }
+    render.stats = stats;
+}
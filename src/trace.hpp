@@ -2,12 +2,78 @@
 #define TRACE_HPP
 
 #include "camera.hpp"
+#include "framebuffer.hpp"
 #include "params.hpp"
 #include "scene.hpp"
+#include "stats.hpp"
+#include <string>
 #include <utility>
 #include <vector>
 
-std::vector<std::vector<Color>> rayTrace(const PerspectiveCamera& camera, const Scene& scene,
-                                         const RenderParams& params);
+/* The rendered image, in linear radiance (see tonemap.hpp to display it), along with its
+   first-hit feature buffers (albedo, normal and depth), each averaged over all the samples of
+   a pixel, and the total cost of each pixel if RenderParams::pixelCost is set. */
+struct RenderResult {
+    Framebuffer color;
+    Framebuffer albedo;
+    NormalBuffer normal;
+    DepthBuffer depth;
+    CostBuffer cost;
+    RenderStats stats;
 
-#endif
\ No newline at end of file
+    RenderResult(int width, int height)
+        : color(width, height), albedo(width, height),
+          normal(width, height, Vector3(0.0f, 0.0f, 0.0f)), depth(width, height),
+          cost(width, height) {}
+
+    /* Copies the buffers of a render of a region, whose top-left pixel is (x0, y0). */
+    void paste(const RenderResult& region, int x0, int y0) {
+        color.paste(region.color, x0, y0);
+        albedo.paste(region.albedo, x0, y0);
+        normal.paste(region.normal, x0, y0);
+        depth.paste(region.depth, x0, y0);
+        cost.paste(region.cost, x0, y0);
+    }
+};
+
+struct Accumulator;
+
+using Tile = PixelRect;
+
+std::vector<Tile> makeTiles(int width, int height, int tileSize);
+/* Tiles covering the region, starting from its top-left corner. */
+std::vector<Tile> makeTiles(const PixelRect& region, int tileSize);
+
+/* Adds samples to every pixel of the tile until it has targetSamples samples. */
+using TileRenderer = void (*)(const PerspectiveCamera& camera, const Scene& scene,
+                              const RenderParams& params, const Tile& tile, int targetSamples,
+                              Accumulator& accumulator, RenderStats& stats);
+
+/* Returns the renderTile variant specialized for the integrator options of params. */
+TileRenderer selectTileRenderer(const RenderParams& params);
+
+void renderTile(const PerspectiveCamera& camera, const Scene& scene, const RenderParams& params,
+                const Tile& tile, int targetSamples, Accumulator& accumulator,
+                RenderStats& stats);
+
+/* Renders the remaining samples of the tile, by passes aligned on those of rayTrace so that
+   the result is the same as if the tile had been rendered by rayTrace. */
+void renderTilePasses(const PerspectiveCamera& camera, const Scene& scene,
+                      const RenderParams& params, const Tile& tile, Accumulator& accumulator,
+                      RenderStats& stats);
+
+std::string progressBar(float progressRatio);
+
+/* Renders params.region() of the frame. The result always has the size of the frame, and is
+   black outside of the region. */
+RenderResult rayTrace(const PerspectiveCamera& camera, const Scene& scene,
+                      const RenderParams& params);
+
+/* Renders again the given regions of an existing full-frame render, e.g. after a change to the
+   scene that only affects them. The rest of the render is left untouched, and its stats are
+   replaced by those of the regions. Checkpointing is disabled. */
+void rayTraceRegions(const PerspectiveCamera& camera, const Scene& scene,
+                     const RenderParams& params, const std::vector<PixelRect>& regions,
+                     RenderResult& render);
+
+#endif
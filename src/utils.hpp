@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <optional>
 #include <random>
 #include <utility>
@@ -12,6 +13,39 @@ template <typename T> T sqr(T x) { return x * x; }
 constexpr float PI = 3.141592f;
 constexpr float TWO_PI = 2.0f * PI;
 
+/* PCG32 ("PCG: A Family of Simple Fast Space-Efficient Statistically Good Algorithms for Random
+   Number Generation", O'Neill 2014) : a 64-bit LCG whose output is permuted. Its whole state is
+   two words, so that reseeding it for every pixel costs next to nothing, unlike std::mt19937
+   and its 624 words. The stream selects one of 2^63 distinct sequences for the same seed. */
+class PCG32 {
+    uint64_t state = 0;
+    uint64_t increment = 1;
+
+  public:
+    explicit PCG32(uint64_t seed, uint64_t stream = 0) { reseed(seed, stream); }
+
+    void reseed(uint64_t seed, uint64_t stream = 0) {
+        state = 0;
+        increment = stream << 1 | 1u;
+        next();
+        state += seed;
+        next();
+    }
+
+    uint32_t next() {
+        const uint64_t old = state;
+        state = old * 6364136223846793005ull + increment;
+        const auto xorShifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+        const auto rotation = static_cast<uint32_t>(old >> 59);
+        return xorShifted >> rotation | xorShifted << ((32u - rotation) & 31u);
+    }
+};
+
+inline PCG32& randomGenerator() {
+    thread_local PCG32 generator{std::random_device{}()};
+    return generator;
+}
+
 /* Returns a random float uniformly between 0.0f and 1.0f. */
 inline float random() {
     /* Interesting discoveries here : while far from a perfect PRNG, the C-style
@@ -22,17 +56,36 @@ inline float random() {
     Explanation for the slowness of rand() in multithreaded context :
     https://stackoverflow.com/questions/10624755/openmp-program-is-slower-than-sequential-one */
 
-    // Modern C++ version :
-    thread_local std::mt19937 generator{std::random_device{}()};
-    thread_local std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
-    return distribution(generator);
-    // This may be slightly faster (less "crypto-secure" but we're raytracing anyways)
-    // return static_cast<float>generator() / generator.max();
+    // The 24 high bits of a PCG32 output, which a float represents exactly :
+    return static_cast<float>(randomGenerator().next() >> 8) * (1.0f / 16777216.0f);
+    // std::mt19937 version, slower and much more expensive to reseed :
+    // thread_local std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+    // return distribution(generator);
 
     // Old C-style version (fast when monothreaded, but synchronization issues with OpenMP) :
     // return static_cast<float>(rand()) / RAND_MAX;
 }
 
+/* SplitMix64 finalizer : turns consecutive integers into well-distributed 64-bit values. */
+inline uint64_t hash(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/* Maps the 24 high bits of bits to a float uniformly in [0, 1). */
+inline float unitFloat(uint64_t bits) {
+    return static_cast<float>(bits >> 40) * (1.0f / 16777216.0f);
+}
+
+/* Reseeds the generator of the calling thread, to make the following random numbers
+   reproducible (e.g. when a render is resumed). Distinct streams give distinct sequences, and
+   distinct seeds only collide through their 64-bit hash. */
+inline void seedRandom(uint64_t seed, uint64_t stream = 0) {
+    randomGenerator().reseed(hash(seed), stream);
+}
+
 inline float signBitToNumber(bool signBit) { return signBit ? 1.0f : -1.0f; }
 
 inline bool floatingPointEquality(float a, float b) {
@@ -67,10 +120,6 @@ inline std::optional<std::pair<float, float>> solveSecondDegreeEquation(float a,
     float t2{(-b + std::sqrt(discriminant)) / (2 * a)};
     return std::make_pair(t1, t2);
 }
-
-inline std::pair<float, float> randomOffsetPixel(int x, int y) {
-    return {x + Utils::random() - 0.5f, y + Utils::random() - 0.5f};
-}
 } // namespace Utils
 
 #endif
\ No newline at end of file